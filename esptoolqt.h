@@ -38,8 +38,18 @@
 #include <QSerialPort>
 #include <QByteArray>
 #include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
 #include <vector>
 #include "targets/esp_base.h"
+#include "src/payload_cache.h"
+#include "src/command_batch.h"
+#include "src/transport.h"
+#include "src/trace.h"
+#include "src/rto.h"
+
+class EspFlashManifest;
 
 enum ResetStrategy { classic_reset, usb_jtag_serial_reset };
 
@@ -49,6 +59,13 @@ enum class VerifyBlockResult {
     Error,
 };
 
+enum class CommandStatus {
+    Ok,
+    Unsupported,    // explicit error reply: the loader does not know the command
+    Failed,         // explicit error reply for any other reason
+    NoReply,        // timeout or a reply to something else, the link may be out of step
+};
+
 struct EspTargetInfo {
     bool connected;
     QString com_port;
@@ -58,6 +75,73 @@ struct EspTargetInfo {
     uint32_t flash_size;
 };
 
+struct FastReadStats {
+    uint32_t max_in_flight = 0;
+    uint32_t ack_every = 0;
+    quint64 frames = 0;
+    quint64 acks = 0;
+    quint64 payload_bytes = 0;
+    int transfer_ms = 0;
+    int cmd_reply_ms = 0;
+    int data_frames_ms = 0;
+    int ack_send_ms = 0;
+    int first_frame_ms = 0;
+    int max_frame_ms = 0;
+    int max_ack_ms = 0;
+    quint64 slow_frame_count = 0;
+    quint64 slow_ack_count = 0;
+    double kbit_s = 0;
+};
+
+struct AdaptiveReadStats {
+    uint32_t probe_window = 0;
+    uint32_t chosen_window = 0;
+    uint32_t segments = 0;
+    uint32_t degrade_count = 0;
+    std::vector<uint32_t> windows;
+};
+
+struct FlashBadRange {
+    uint32_t offset = 0;
+    uint32_t size = 0;
+    bool repaired = false;
+};
+
+struct EspProgress {
+    quint64 done = 0;
+    quint64 total = 0;
+    float percent = 0;
+    double bytes_per_second = 0;    // average since the operation started
+    qint64 eta_ms = -1;             // -1 until a rate is known
+};
+
+// Picks the progress updates worth passing on: one whenever the operation
+// advanced by min_step percent, at most max_rate_hz a second (0 = no limit),
+// and always the final one. done going back to 0 or down, or a new total,
+// starts a new operation.
+class EspProgressThrottle {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    bool update(quint64 done, quint64 total, Clock::time_point now);   // true on a new operation
+    bool due(quint64 done, quint64 total, float min_step, int max_rate_hz, Clock::time_point now);
+    Clock::time_point started() const { return start_; }
+
+private:
+    quint64 total_ = 0;
+    quint64 last_done_ = 0;
+    quint64 next_bytes_ = 0;
+    quint64 emitted_done_ = 0;
+    Clock::time_point start_;
+    Clock::time_point last_emit_;
+};
+
+struct BaudProbeResult {
+    uint32_t baud = 0;
+    bool ok = false;
+    double kbit_s = 0;
+};
+
 class EspToolQt : public QObject
 {
     Q_OBJECT
@@ -73,14 +157,62 @@ private:
     bool flashBegin(uint32_t size_of_data, uint32_t number_of_data_packets, uint32_t max_packet_size, uint32_t memory_offset, bool compressed);
     bool flashDataOneBlock(uint32_t sequence_number, std::vector<uint8_t> &data, bool compressed);
     bool flashData(const uint32_t memory_offset, const std::vector<uint8_t>& data, bool compress);
+    bool flashDataRange(const uint32_t memory_offset, const std::vector<uint8_t>& data, bool compress);
+    CommandStatus stubEraseRegion(uint32_t memory_offset, uint32_t size);
+    uint32_t erasedRunThreshold(bool compress) const;
+    bool stubEraseUsable(CommandStatus status, const char* what);
+    CommandStatus slipCommandStatus(uint8_t command, const std::vector<uint8_t>& data_field, uint32_t checksum, uint32_t timeout_ms, double work = 1);
+    bool spiFlashErase(uint32_t command, uint32_t address, int typical_ms, int timeout_ms);
+    bool spiFlashWaitIdle(int typical_ms, int timeout_ms);
+    quint64 flash_skipped_bytes_ = 0;
+    static uint32_t uploadBlockSize(uint32_t total_length);
+    bool flashBlockVerified(uint32_t memory_offset, const std::vector<uint8_t>& block, bool compressed, bool written_bad = false);
+    bool planCompression(const std::vector<uint8_t>& data, bool compressed);
+    EspPayloadCache::PayloadPtr deflatePayload(uint32_t memory_offset, const std::vector<uint8_t>& data, bool* cached);
+    void prepareFlashData(uint32_t memory_offset, const std::vector<uint8_t>& data, bool compress);
+    bool flashBlockOverlapped(uint32_t memory_offset, const std::vector<uint8_t>& block, bool compressed, std::function<void()> prepare_next);
+    int flash_deflate_level_ = 9;
 
     // verify flash
     bool verifyFlashPr(uint32_t memory_offset, std::vector<uint8_t> data);
+    bool sendFlashMd5Request(uint32_t memory_offset, uint32_t size, bool pipelined = false);
+    bool bisectBadRanges(uint32_t memory_offset, const uint8_t* data, uint32_t size, bool known_bad, std::vector<FlashBadRange>* bad);
+    void logBadRanges(const std::vector<FlashBadRange>& bad);
+    bool receiveFlashMd5(uint32_t size, std::vector<uint8_t>* md5, bool buffered = false);
     bool serialWriteWithoutInputClear(std::vector<uint8_t> data, int timeout_ms = 1000);
+    bool serialWriteNoWait(const std::vector<uint8_t>& data);
     std::vector<uint8_t> serialReadOneFrameBuffered(int timeout_ms = 1000);
+
+    // read flash
+    enum class FastReadStatus { Ok, Cancelled, CommandFailed, FrameError, Md5Mismatch };
+    FastReadStatus readFlashFastRange(uint32_t memory_offset, uint32_t size, uint32_t max_in_flight, std::vector<uint8_t>& received_data);
+    bool recoverFastReadLink(uint32_t range_size, uint32_t max_in_flight);
     QByteArray serial_frame_buffer_;
+    quint64 read_progress_base_ = 0;
+    quint64 read_progress_total_ = 0;
+    void readProgress(quint64 done, quint64 total);
+    void reportProgress(quint64 done, quint64 total);
+    bool progress_listeners_ = false;
+    EspProgressThrottle progress_throttle_;
     std::atomic<void*> serial_native_handle_{nullptr};
 
+    // transport, tracing and reply timeouts
+    EspTransport* io() const;
+    std::unique_ptr<EspSerialTransport> serial_transport_;
+    EspTransport* transport_ = NULL;
+    std::unique_ptr<EspCaptureTransport> capture_;
+    EspTrace* trace_ = NULL;
+    int trace_track_ = 0;
+    EspTrace::Span traceSpan(const char* name, const char* category) const;
+    EspRtoEstimator rto_;
+    int replyTimeout(int command_class, int fallback_ms, quint64 wire_bytes, double work = 1) const;
+    void replySample(int command_class, qint64 elapsed_ms, quint64 wire_bytes, bool replied, double work = 1);
+    void logRtoDiag() const;
+    uint32_t readRegTimed(uint32_t address, int reply_class);
+
+    // resumable jobs and sector cache
+    bool flashDeviceIdentity(QString* mac, uint32_t* flash_id);
+
 public:
     // helpers
     void appendU32(std::vector<uint8_t>*, uint32_t);
@@ -109,6 +241,11 @@ public:
     QVector<QString> getFamilies();
     QVector<QString> getTargets(QString familie);
     void setPortName(QString);
+    void setTransport(EspTransport* transport);
+    EspTransport* serialTransport() const { return serial_transport_.get(); }
+    bool startCapture(const QString& path);
+    void stopCapture();
+    void setTrace(EspTrace* trace, const QString& track_name = QString());
     bool openPort();
     bool openPort(QString);
     bool openPort(QString port, int baud);
@@ -118,6 +255,7 @@ public:
     QString serialErrorString() const;
     bool serialWrite(std::vector<uint8_t>, int timeout_ms = 1000);
     std::vector<uint8_t> serialRead(int timeout_ms = 1000);
+    void serialDrain(int idle_ms, int max_ms);
     std::vector<uint8_t> serialReadOneFrame(int timeout_ms = 1000);
     bool syncWithRomBootloader(int attempts = 5);
     bool autoConnect(QString port = NULL);
@@ -131,6 +269,9 @@ public:
     // stub upload
     bool stubUpload();
 
+    // batches of independent commands
+    std::vector<EspBatchResult> runBatch(const EspCommandBatch& batch);
+
     // chip info
     bool getChipDescription(QString* chip_description);
     bool getChipFeatures(QString* features);
@@ -138,10 +279,15 @@ public:
     bool getChipBaseMac(std::vector<uint8_t>* mac); // This function is implemented not for all families.
 
     bool changeBaud(uint32_t baud = 460800);
+    uint32_t changeBaudToFastest(std::vector<uint32_t> candidates = {921600, 1500000, 2000000, 3000000}, uint32_t probe_size = 0x10000);
+    std::vector<BaudProbeResult> lastBaudProbe;
     uint32_t getFlashSize();
+    uint32_t getFlashId();
     void disconnect();
     std::vector<uint8_t> slip_encode (uint8_t command, std::vector<uint8_t>data, uint32_t checksum = 0);
-    bool slipCommandSend (uint8_t command, std::vector<uint8_t>data_field, uint32_t checksum = 0, uint32_t timeout_ms = 1000);
+    bool slipCommandSend (uint8_t command, std::vector<uint8_t>data_field, uint32_t checksum = 0, uint32_t timeout_ms = 1000, double work = 1);
+    bool adaptive_timeouts = true;      // learn reply timeouts per command, timeout_ms is the fallback
+    const EspRtoEstimator& rtoEstimator() const { return rto_; }
 
     std::vector<uint8_t> slip_raw_encode (std::vector<uint8_t>&);
     bool slip_raw_send (std::vector<uint8_t>&, int timeout_ms = 1000);
@@ -157,24 +303,54 @@ public:
     // read flash
     std::vector<uint8_t> readFlash(uint32_t memory_offset, uint32_t size);
     std::vector<uint8_t> readFlashFast(uint32_t memory_offset, uint32_t size, uint32_t max_in_flight = 64);
+    std::vector<uint8_t> readFlashFastAdaptive(uint32_t memory_offset, uint32_t size);
+    std::vector<uint8_t> readFlashResilient(uint32_t memory_offset, uint32_t size, uint32_t max_in_flight = 64);
+    FastReadStats lastFastReadStats;
+    uint32_t fast_read_ack_every = 1;       // ACK every k frames (capped at half of max_in_flight)
+    int fast_read_ack_max_delay_ms = 20;    // ...or when this much time passed since the last ACK
+    bool fast_read_ack_async = false;       // do not wait for ACK bytes to drain
+    AdaptiveReadStats lastAdaptiveReadStats;
     std::vector<uint8_t> readFlashWithAgent(uint32_t memory_offset, uint32_t size);
+    bool readFlashToFile(uint32_t memory_offset, uint32_t size, const QString& path);
+    std::vector<uint8_t> readFlashSparse(uint32_t memory_offset, uint32_t size, uint32_t region_size = 1024 * 1024);
+    static const std::vector<uint8_t>& erasedMd5(uint32_t size);
+    std::vector<uint8_t> readFlashCached(uint32_t memory_offset, uint32_t size);
+    QString flash_cache_dir;    // sector cache root, empty disables readFlashCached() caching
 
     // write flash
     bool flashUpload(uint32_t memory_offset, std::vector<uint8_t> data, bool compressed = true);
+    bool flashUploadJournaled(uint32_t memory_offset, std::vector<uint8_t> data, const QString& journal_path, bool compressed = true);
+    bool flashManifest(const EspFlashManifest& manifest, bool compressed = true);
+    bool skip_erased_sectors = true;    // erase all-0xFF sectors instead of sending them
+    uint32_t skip_erased_min_compressed = 256 * 1024;  // erased run worth a split in deflate uploads
+    QString payload_cache_dir;          // on-disk compressed payload cache, shared between processes
+    bool adaptive_compression = true;   // per image raw/deflate and level choice from sampling
+    bool pipelined_verify = true;       // verify block N while block N+1 is compressed
+
+    // erase flash
+    bool eraseRegion(uint32_t memory_offset, uint32_t size);
+    bool eraseFlash();
 
     // verify flash
     bool verifyFlash(uint32_t memory_offset, std::vector<uint8_t> data);
+    uint32_t verify_md5_depth = 4;      // MD5 requests queued on the stub at once
+    bool locateBadRanges(uint32_t memory_offset, const std::vector<uint8_t>& data, std::vector<FlashBadRange>* bad, bool known_bad = true);
+    std::vector<FlashBadRange> lastBadRanges;   // sectors found different by the last write or verify
     bool verifyFlashBlockMd5(uint32_t memory_offset, const std::vector<uint8_t>& data);
+    bool readFlashMd5(uint32_t memory_offset, uint32_t size, std::vector<uint8_t>* md5);
     VerifyBlockResult verifyFlashBlockMd5Detailed(uint32_t memory_offset, const std::vector<uint8_t>& data);
 
     void progress(float);
     bool progress_signal_enabled = true;
     bool serial_progress_enabled = false;
     bool progress_bytes_enabled  = false;
+    int progress_max_rate_hz = 20;      // progress updates per second at most, 0 = no limit
+    float progress_min_step = 0.5f;     // percent the operation must advance between updates
 
 signals:
     void progress_signal(int);
     void progress_bytes_signal(quint64 current, quint64 total);
+    void progress_info_signal(const EspProgress& info);
 };
 
 #endif // ESP_TOOL_QT_H
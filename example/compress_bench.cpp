@@ -0,0 +1,96 @@
+/**
+ ******************************************************************************
+ * @file           : example/compress_bench.cpp
+ * @brief          : Compares payload deflate backends, levels and the parallel path.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ * @details
+ *
+ * Usage: compress_bench [image.bin ...]
+ * Without arguments a synthetic 4 MB image (code-like data, text and
+ * erased padding) is used. Every compiled in backend is run at levels
+ * 1, 3, 6 and 9, plus the parallel zlib path; every result is inflated back
+ * and checked.
+ *
+ ******************************************************************************
+ */
+
+#include "../src/compress.h"
+
+#include <zlib.h>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<uint8_t> syntheticImage()
+{
+    std::vector<uint8_t> image(4 * 1024 * 1024, 0xFF);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < 3 * 1024 * 1024; i++) {
+        seed = seed * 1103515245u + 12345u;
+        image[i] = (i % 4096 < 1024) ? static_cast<uint8_t>("esp flash image text "[i % 21]) : static_cast<uint8_t>(seed >> 26);
+    }
+    return image;
+}
+
+bool roundTrips(const std::vector<uint8_t>& source, const std::vector<uint8_t>& packed)
+{
+    std::vector<uint8_t> unpacked(source.size());
+    uLongf unpacked_size = unpacked.size();
+    return uncompress(unpacked.data(), &unpacked_size, packed.data(), packed.size()) == Z_OK &&
+           unpacked_size == source.size() && unpacked == source;
+}
+
+template <typename Compress>
+void run(const char* name, const std::vector<uint8_t>& image, int level, Compress compress)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const std::vector<uint8_t> packed = compress(image, level);
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::printf("  %-11s level=%d  %8.1f ms  %8.1f MB/s  ratio=%.4f  %s\n",
+                name, level, ms, image.size() / 1024.0 / 1024.0 / (ms / 1000.0),
+                static_cast<double>(packed.size()) / image.size(),
+                roundTrips(image, packed) ? "ok" : "BROKEN");
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::pair<std::string, std::vector<uint8_t>>> images;
+    for (int i = 1; i < argc; i++) {
+        std::ifstream file(argv[i], std::ios::binary);
+        if (!file) {
+            std::fprintf(stderr, "can't open %s\n", argv[i]);
+            return 1;
+        }
+        images.emplace_back(argv[i], std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {}));
+    }
+    if (images.empty()) images.emplace_back("synthetic", syntheticImage());
+
+    for (const auto& image : images) {
+        std::printf("%s (%zu bytes)\n", image.first.c_str(), image.second.size());
+        for (const DeflateBackend* backend : deflate_backends()) {
+            for (int level : {1, 3, 6, 9}) {
+                run(backend->name(), image.second, level, [backend](const std::vector<uint8_t>& data, int l) { return backend->compress(data, l); });
+            }
+        }
+        select_deflate_backend("zlib");
+        for (int level : {1, 3, 6, 9}) {
+            run("parallel", image.second, level, [](const std::vector<uint8_t>& data, int l) { return compress_vector_parallel(data, l); });
+        }
+    }
+    return 0;
+}
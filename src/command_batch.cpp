@@ -0,0 +1,239 @@
+/**
+ ******************************************************************************
+ * @file           : src/command_batch.cpp
+ * @brief          : Implements batches of heterogeneous target operations.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ */
+
+#include "../esptoolqt.h"
+#include "command_batch.h"
+#include "defines.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include <cmath>
+#include <deque>
+
+using std::vector;
+
+EspCommandBatch &EspCommandBatch::readReg(const QString &name, uint32_t address)
+{
+    Step step;
+    step.kind = Kind::ReadReg;
+    step.name = name;
+    step.address = address;
+    steps_.push_back(step);
+    return *this;
+}
+
+EspCommandBatch &EspCommandBatch::writeReg(const QString &name, uint32_t address, uint32_t value)
+{
+    Step step;
+    step.kind = Kind::WriteReg;
+    step.name = name;
+    step.address = address;
+    step.value = value;
+    steps_.push_back(step);
+    return *this;
+}
+
+EspCommandBatch &EspCommandBatch::flashMd5(const QString &name, uint32_t memory_offset, uint32_t size)
+{
+    Step step;
+    step.kind = Kind::FlashMd5;
+    step.name = name;
+    step.address = memory_offset;
+    step.value = size;
+    steps_.push_back(step);
+    return *this;
+}
+
+EspCommandBatch &EspCommandBatch::call(const QString &name, Call call)
+{
+    Step step;
+    step.kind = Kind::Call;
+    step.name = name;
+    step.call = std::move(call);
+    steps_.push_back(step);
+    return *this;
+}
+
+namespace {
+
+uint8_t batchCommand(const EspCommandBatch::Step &step)
+{
+    switch (step.kind) {
+    case EspCommandBatch::Kind::ReadReg:  return ESP_READ_REG;
+    case EspCommandBatch::Kind::WriteReg: return ESP_WRITE_REG;
+    case EspCommandBatch::Kind::FlashMd5: return 0x13;
+    default:                              return 0;
+    }
+}
+
+// fixed timeout, used until the reply time of the command is learned
+int batchTimeout(const EspCommandBatch::Step &step)
+{
+    if (step.kind == EspCommandBatch::Kind::FlashMd5) {
+        return 5000 * (int)ceil((float)step.value / ((float)1024 * 1024));
+    }
+    return 1000;
+}
+
+// MB hashed for an MD5, 1 for the rest
+double batchWork(const EspCommandBatch::Step &step)
+{
+    if (step.kind == EspCommandBatch::Kind::FlashMd5) return (double)step.value / (1024 * 1024);
+    return 1;
+}
+
+}
+
+// Run a batch. Simple commands between call() steps are pipelined: up to
+// max_in_flight requests are written without waiting, replies are read in
+// order and checked against the command they answer. Replies carry no
+// sequence number, so after a timeout or a reply to something else a late
+// frame could be taken for the next step: the batch stops there, the input
+// is drained and every step not yet answered stays failed.
+std::vector<EspBatchResult> EspToolQt::runBatch(const EspCommandBatch &batch) {
+    QElapsedTimer batch_timer;
+    batch_timer.start();
+    const vector<EspCommandBatch::Step> &steps = batch.steps();
+    vector<EspBatchResult> results(steps.size());
+    for (size_t i = 0; i < steps.size(); i++) results[i].name = steps[i].name;
+
+    // check that target is connected
+    if (target == NULL || !io()->isOpen()) {
+        qInfo() << "[Error] Target is not connected";
+        return results;
+    }
+
+    io()->clear();
+    size_t pipelined = 0;
+    size_t i = 0;
+    bool out_of_step = false;
+    while (i < steps.size() && !out_of_step) {
+        if (isCancelled()) {
+            closePort();
+            return results;
+        }
+
+        if (steps[i].kind == EspCommandBatch::Kind::Call) {
+            QElapsedTimer step_timer;
+            step_timer.start();
+            results[i].ok = steps[i].call(*this, results[i]);
+            results[i].elapsed_ms = step_timer.elapsed();
+            // calls leave the port in their own state
+            if (io()->isOpen()) io()->clear();
+            i++;
+            continue;
+        }
+
+        // run of simple commands up to the next call()
+        size_t end = i;
+        while (end < steps.size() && steps[end].kind != EspCommandBatch::Kind::Call) end++;
+
+        // alone: nothing was in flight ahead of it, so its reply time is
+        // worth learning from
+        struct Pending { size_t step; QElapsedTimer timer; quint64 wire_bytes; bool alone; };
+        std::deque<Pending> in_flight;
+        auto timeout = [this, &steps](const Pending &pending) {
+            const EspCommandBatch::Step &step = steps[pending.step];
+            return replyTimeout(batchCommand(step), batchTimeout(step), pending.wire_bytes, batchWork(step));
+        };
+        // wait out the replies still owed, then whatever else arrives
+        auto drain = [this, &in_flight, &timeout]() {
+            if (!isSerialUsable()) return;
+            for (const Pending &pending : in_flight) {
+                if (serialReadOneFrame(timeout(pending)).empty()) break;
+            }
+            in_flight.clear();
+            serialDrain(100, 1000);
+        };
+        size_t next = i;
+        while (next < end || !in_flight.empty()) {
+            while (next < end && in_flight.size() < std::max<uint32_t>(1, batch.max_in_flight)) {
+                const EspCommandBatch::Step &step = steps[next];
+                vector<uint8_t> data_field;
+                appendU32(&data_field, step.address);
+                if (step.kind == EspCommandBatch::Kind::WriteReg) {
+                    appendU32(&data_field, step.value);
+                    appendU32(&data_field, 0xFFFFFFFF);
+                    appendU32(&data_field, 0);
+                } else if (step.kind == EspCommandBatch::Kind::FlashMd5) {
+                    appendU32(&data_field, step.value);
+                    appendU32(&data_field, 0);
+                    appendU32(&data_field, 0);
+                }
+                const vector<uint8_t> packet = slip_encode(batchCommand(step), data_field);
+                Pending pending;
+                pending.step = next;
+                pending.wire_bytes = packet.size() + ESP_REPLY_WIRE_BYTES
+                    + (step.kind == EspCommandBatch::Kind::FlashMd5 ? 32 : 0);
+                pending.alone = in_flight.empty();
+                pending.timer.start();
+                if (!serialWriteNoWait(packet)) {
+                    drain();
+                    return results;
+                }
+                in_flight.push_back(pending);
+                next++;
+            }
+
+            Pending pending = in_flight.front();
+            in_flight.pop_front();
+            const EspCommandBatch::Step &step = steps[pending.step];
+            EspBatchResult &result = results[pending.step];
+            const vector<uint8_t> frame = serialReadOneFrame(timeout(pending));
+            if (isCancelled()) {
+                closePort();
+                return results;
+            }
+            result.elapsed_ms = pending.timer.elapsed();
+            if (pending.alone || frame.empty()) {
+                replySample(batchCommand(step), result.elapsed_ms, pending.wire_bytes, !frame.empty(), batchWork(step));
+            }
+            SlipReply reply = slip_parse(frame);
+            if (!reply.valid || reply.command != batchCommand(step)) {
+                qInfo().noquote() << QString("[ERROR] Batch step %1 got no matching reply, stopping the batch").arg(step.name);
+                drain();
+                out_of_step = true;
+                break;
+            }
+
+            result.value = reply.value;
+            if (step.kind == EspCommandBatch::Kind::FlashMd5) {
+                if (reply.data.size() < 18) continue;
+                reply.data.resize(reply.data.size() - 2);
+                result.data = reply.data;
+                result.ok = true;
+            } else {
+                result.ok = !reply.data.empty() && reply.data[0] == 0;
+            }
+        }
+        pipelined += next - i;
+        i = end;
+    }
+
+    if (isDiagEnabled()) {
+        int failed = 0;
+        for (const EspBatchResult &result : results) failed += result.ok ? 0 : 1;
+        qInfo().noquote() << QString("[esp-diag] batch steps=%1 pipelined=%2 failed=%3 total_ms=%4")
+            .arg(static_cast<qulonglong>(steps.size()))
+            .arg(static_cast<qulonglong>(pipelined))
+            .arg(failed)
+            .arg(batch_timer.elapsed());
+        for (const EspBatchResult &result : results) {
+            qInfo().noquote() << QString("[esp-diag] batch step=%1 ok=%2 ms=%3")
+                .arg(result.name).arg(result.ok ? "yes" : "no").arg(result.elapsed_ms);
+        }
+    }
+    return results;
+}
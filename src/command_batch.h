@@ -0,0 +1,79 @@
+/**
+ ******************************************************************************
+ * @file           : src/command_batch.h
+ * @brief          : Declares batches of heterogeneous target operations.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ * @details
+ *
+ * A batch is an ordered list of steps run by EspToolQt::runBatch() (or
+ * EspSession::runBatch() on the session thread). Register reads/writes and
+ * flash MD5 requests are simple request/reply commands: runs of them are
+ * sent back to back and their replies matched in order. call() steps run
+ * arbitrary code (read MAC, write an NVS page, reset...) and act as
+ * barriers. The input buffer is flushed once per batch, not per command.
+ *
+ * Usage Example:
+ * ```cpp
+ * EspCommandBatch batch;
+ * batch.readReg("efuse0", 0x3FF5A000).readReg("efuse1", 0x3FF5A004)
+ *      .flashMd5("nvs", 0x9000, 0x6000)
+ *      .call("reset", [](EspToolQt& tool, EspBatchResult&) { tool.resetFromBoot(); return true; });
+ * std::vector<EspBatchResult> results = tool.runBatch(batch);
+ * ```
+ *
+ ******************************************************************************
+ */
+
+#ifndef ESP_COMMAND_BATCH_H
+#define ESP_COMMAND_BATCH_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <QString>
+
+class EspToolQt;
+
+struct EspBatchResult {
+    QString name;
+    bool ok = false;
+    uint32_t value = 0;             // register value
+    std::vector<uint8_t> data;      // MD5 or call() output
+    int elapsed_ms = 0;             // send to reply, or call duration
+};
+
+class EspCommandBatch
+{
+public:
+    enum class Kind { ReadReg, WriteReg, FlashMd5, Call };
+    using Call = std::function<bool(EspToolQt&, EspBatchResult&)>;
+
+    struct Step {
+        Kind kind = Kind::Call;
+        QString name;
+        uint32_t address = 0;
+        uint32_t value = 0;         // WriteReg value, FlashMd5 size
+        Call call;
+    };
+
+    EspCommandBatch &readReg(const QString &name, uint32_t address);
+    EspCommandBatch &writeReg(const QString &name, uint32_t address, uint32_t value);
+    EspCommandBatch &flashMd5(const QString &name, uint32_t memory_offset, uint32_t size);
+    EspCommandBatch &call(const QString &name, Call call);
+
+    const std::vector<Step> &steps() const { return steps_; }
+    uint32_t max_in_flight = 8;     // simple commands queued on the target at once
+
+private:
+    std::vector<Step> steps_;
+};
+
+#endif // ESP_COMMAND_BATCH_H
@@ -0,0 +1,297 @@
+/**
+ ******************************************************************************
+ * @file           : src/compress.cpp
+ * @brief          : Implements deflate helpers for flash payloads.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ */
+
+#include "compress.h"
+
+#include <zlib.h>
+#ifdef ESPTOOL_QT_WITH_ZLIB_NG
+#include <zlib-ng.h>
+#endif
+#ifdef ESPTOOL_QT_WITH_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+namespace {
+
+const size_t DEFLATE_WINDOW = 32 * 1024;
+
+// zlib header (CMF/FLG) for a 32 KB window at the given level, RFC 1950
+void appendZlibHeader(std::vector<uint8_t>& out, int level) {
+    const uint8_t cmf = 0x78;
+    const uint8_t flevel = level < 2 ? 0 : (level < 6 ? 1 : (level == 6 ? 2 : 3));
+    uint8_t flg = flevel << 6;
+    flg += 31 - ((cmf << 8) + flg) % 31;
+    out.push_back(cmf);
+    out.push_back(flg);
+}
+
+struct DeflateChunk {
+    size_t begin = 0;
+    size_t size = 0;
+    uLong adler = 1;
+    std::vector<uint8_t> out;
+    bool ok = false;
+};
+
+// Raw deflate of one chunk, primed with the preceding window of the input.
+void deflateChunk(const std::vector<uint8_t>& source, DeflateChunk& chunk, int level, bool last) {
+    z_stream stream = {};
+    if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return;
+
+    if (chunk.begin != 0) {
+        const size_t dict_size = std::min(DEFLATE_WINDOW, chunk.begin);
+        deflateSetDictionary(&stream, source.data() + chunk.begin - dict_size, dict_size);
+    }
+
+    // sync flush adds an empty stored block: 5 bytes, plus margin
+    chunk.out.resize(deflateBound(&stream, chunk.size) + 16);
+    stream.next_in = const_cast<Bytef*>(source.data() + chunk.begin);
+    stream.avail_in = chunk.size;
+    stream.next_out = chunk.out.data();
+    stream.avail_out = chunk.out.size();
+    const int result = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    chunk.ok = last ? result == Z_STREAM_END : (result == Z_OK && stream.avail_in == 0);
+    chunk.out.resize(chunk.out.size() - stream.avail_out);
+    deflateEnd(&stream);
+
+    chunk.adler = adler32(1L, source.data() + chunk.begin, chunk.size);
+}
+
+class ZlibBackend : public DeflateBackend
+{
+public:
+    const char* name() const override { return "zlib"; }
+
+    // https://stackoverflow.com/questions/4538586/how-to-compress-a-buffer-with-zlib
+    std::vector<uint8_t> compress(const std::vector<uint8_t>& source, int level) const override {
+        std::vector<uint8_t> destination;
+        unsigned long source_length = source.size();
+        unsigned long destination_length = compressBound(source_length);
+        destination.resize(destination_length);
+
+        compress2((Bytef *) destination.data(), &destination_length, (Bytef *) source.data(), source_length, level);
+        destination.resize(destination_length);
+
+        return destination;
+    }
+};
+
+#ifdef ESPTOOL_QT_WITH_ZLIB_NG
+class ZlibNgBackend : public DeflateBackend
+{
+public:
+    const char* name() const override { return "zlib-ng"; }
+
+    std::vector<uint8_t> compress(const std::vector<uint8_t>& source, int level) const override {
+        std::vector<uint8_t> destination(zng_compressBound(source.size()));
+        size_t destination_length = destination.size();
+        if (zng_compress2(destination.data(), &destination_length, source.data(), source.size(), level) != Z_OK) return {};
+        destination.resize(destination_length);
+        return destination;
+    }
+};
+#endif
+
+#ifdef ESPTOOL_QT_WITH_LIBDEFLATE
+class LibdeflateBackend : public DeflateBackend
+{
+public:
+    const char* name() const override { return "libdeflate"; }
+
+    std::vector<uint8_t> compress(const std::vector<uint8_t>& source, int level) const override {
+        libdeflate_compressor* compressor = libdeflate_alloc_compressor(level);
+        if (compressor == nullptr) return {};
+        std::vector<uint8_t> destination(libdeflate_zlib_compress_bound(compressor, source.size()));
+        const size_t destination_length = libdeflate_zlib_compress(compressor, source.data(), source.size(),
+                                                                   destination.data(), destination.size());
+        libdeflate_free_compressor(compressor);
+        destination.resize(destination_length);
+        return destination;
+    }
+};
+#endif
+
+const ZlibBackend zlib_backend;
+std::atomic<const DeflateBackend*> selected_backend{&zlib_backend};
+
+}
+
+const std::vector<const DeflateBackend*>& deflate_backends() {
+    static const std::vector<const DeflateBackend*> backends = [] {
+        std::vector<const DeflateBackend*> list{&zlib_backend};
+#ifdef ESPTOOL_QT_WITH_ZLIB_NG
+        static const ZlibNgBackend zlib_ng_backend;
+        list.push_back(&zlib_ng_backend);
+#endif
+#ifdef ESPTOOL_QT_WITH_LIBDEFLATE
+        static const LibdeflateBackend libdeflate_backend;
+        list.push_back(&libdeflate_backend);
+#endif
+        return list;
+    }();
+    return backends;
+}
+
+const DeflateBackend& deflate_backend() {
+    return *selected_backend.load();
+}
+
+bool select_deflate_backend(const std::string& name) {
+    for (const DeflateBackend* backend : deflate_backends()) {
+        if (name == backend->name()) {
+            selected_backend.store(backend);
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<uint8_t> compress_vector(const std::vector<uint8_t>& source, int level) {
+    std::vector<uint8_t> destination = deflate_backend().compress(source, level);
+    if (destination.empty() && &deflate_backend() != &zlib_backend) return zlib_backend.compress(source, level);
+    return destination;
+}
+
+std::vector<uint8_t> compress_vector_parallel(const std::vector<uint8_t>& source, int level, unsigned threads, size_t chunk_size) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    chunk_size = std::max(chunk_size, DEFLATE_WINDOW);
+    const size_t chunk_count = (source.size() + chunk_size - 1) / chunk_size;
+    // chunk dictionaries need the zlib API, other backends compress in one call
+    if (threads == 1 || chunk_count < 2 || &deflate_backend() != &zlib_backend) return compress_vector(source, level);
+
+    std::vector<DeflateChunk> chunks(chunk_count);
+    for (size_t i = 0; i < chunk_count; i++) {
+        chunks[i].begin = i * chunk_size;
+        chunks[i].size = std::min(chunk_size, source.size() - chunks[i].begin);
+    }
+
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i = next++; i < chunk_count; i = next++) {
+            deflateChunk(source, chunks[i], level, i + 1 == chunk_count);
+        }
+    };
+    std::vector<std::thread> pool;
+    const unsigned pool_size = std::min<size_t>(threads, chunk_count);
+    for (unsigned i = 1; i < pool_size; i++) pool.emplace_back(worker);
+    worker();
+    for (std::thread& thread : pool) thread.join();
+
+    std::vector<uint8_t> destination;
+    size_t total = 6;
+    for (const DeflateChunk& chunk : chunks) {
+        if (!chunk.ok) return zlib_backend.compress(source, level);
+        total += chunk.out.size();
+    }
+    destination.reserve(total);
+    appendZlibHeader(destination, level);
+    uLong adler = 1;
+    for (const DeflateChunk& chunk : chunks) {
+        destination.insert(destination.end(), chunk.out.begin(), chunk.out.end());
+        adler = adler32_combine(adler, chunk.adler, chunk.size);
+    }
+    for (int shift = 24; shift >= 0; shift -= 8) destination.push_back((adler >> shift) & 0xFF);
+    return destination;
+}
+
+// Estimate from up to 8 evenly spaced 4 KB samples. Deflate speed and ratio
+// are measured on the samples at levels 1, 6 and 9 and extrapolated to the
+// whole image; wire time assumes 10 bits per byte on the UART.
+DeflatePlan plan_deflate(const std::vector<uint8_t>& data, uint32_t baud, unsigned threads) {
+    const size_t SAMPLE_SIZE = 4096;
+    const size_t SAMPLE_COUNT = 8;
+    const double RAW_ENTROPY_BITS = 7.8;
+
+    DeflatePlan plan;
+    if (data.empty() || baud == 0) return plan;
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<uint8_t> sample;
+    const size_t count = std::min(SAMPLE_COUNT, (data.size() + SAMPLE_SIZE - 1) / SAMPLE_SIZE);
+    const size_t stride = count > 1 ? (data.size() - SAMPLE_SIZE) / (count - 1) : 0;
+    for (size_t i = 0; i < count; i++) {
+        const size_t begin = i * stride;
+        sample.insert(sample.end(), data.begin() + begin, data.begin() + std::min(data.size(), begin + SAMPLE_SIZE));
+    }
+
+    size_t histogram[256] = {};
+    for (uint8_t byte : sample) histogram[byte]++;
+    for (size_t n : histogram) {
+        if (n == 0) continue;
+        const double p = static_cast<double>(n) / sample.size();
+        plan.entropy -= p * std::log2(p);
+    }
+
+    const double wire_ms_per_byte = 10.0 * 1000.0 / baud;
+    plan.compress = false;
+    plan.ratio = 1;
+    plan.estimated_ms = data.size() * wire_ms_per_byte;
+    if (plan.entropy > RAW_ENTROPY_BITS) return plan;
+
+    for (int level : {1, 6, 9}) {
+        const auto start = std::chrono::steady_clock::now();
+        const std::vector<uint8_t> packed = compress_vector(sample, level);
+        const double sample_ms = std::max(0.001, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        const double ratio = static_cast<double>(packed.size()) / sample.size();
+        const double scale = static_cast<double>(data.size()) / sample.size();
+        const double estimated_ms = sample_ms * scale / threads + data.size() * ratio * wire_ms_per_byte;
+        if (estimated_ms < plan.estimated_ms) {
+            plan.compress = true;
+            plan.level = level;
+            plan.ratio = ratio;
+            plan.estimated_ms = estimated_ms;
+        }
+    }
+    return plan;
+}
+
+#ifdef KT_SELFTEST
+#include "kt_selftest/kt_selftest.h"
+
+KT_TEST(esp_compress_parallel_is_one_zlib_stream,
+        "parallel deflate output inflates back with plain zlib uncompress") {
+    std::vector<uint8_t> source(300 * 1024);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < source.size(); i++) {
+        seed = seed * 1103515245u + 12345u;
+        source[i] = (i % 4096 < 2048) ? static_cast<uint8_t>(i / 64) : static_cast<uint8_t>(seed >> 24);
+    }
+
+    const std::vector<uint8_t> packed = compress_vector_parallel(source, 9, 4, 64 * 1024);
+    std::vector<uint8_t> unpacked(source.size());
+    uLongf unpacked_size = unpacked.size();
+    KT_ASSERT_EQ(uncompress(unpacked.data(), &unpacked_size, packed.data(), packed.size()), Z_OK);
+    KT_ASSERT_EQ(static_cast<size_t>(unpacked_size), source.size());
+    KT_ASSERT(unpacked == source);
+}
+
+KT_TEST(esp_compress_plan_sends_random_data_raw,
+        "high entropy data is sent uncompressed, erased padding is deflated") {
+    std::vector<uint8_t> noise(256 * 1024);
+    uint32_t seed = 7;
+    for (uint8_t& byte : noise) {
+        seed = seed * 1103515245u + 12345u;
+        byte = static_cast<uint8_t>(seed >> 24);
+    }
+    KT_ASSERT(!plan_deflate(noise, 921600).compress);
+    KT_ASSERT(plan_deflate(std::vector<uint8_t>(256 * 1024, 0xFF), 921600).compress);
+}
+
+#endif // KT_SELFTEST
@@ -0,0 +1,66 @@
+/**
+ ******************************************************************************
+ * @file           : src/compress.h
+ * @brief          : Declares deflate helpers for flash payloads.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ * @details
+ *
+ * compress_vector() deflates through the selected backend: system zlib,
+ * zlib-ng (native API, ESPTOOL_QT_WITH_ZLIB_NG) or libdeflate
+ * (ESPTOOL_QT_WITH_LIBDEFLATE). All of them produce a zlib stream; the
+ * backend is picked at runtime from the ones compiled in.
+ * compress_vector_parallel() splits the input into chunks and deflates them
+ * on all cores, pigz style: every chunk is primed with the last 32 KB of the
+ * chunk before it, ends on a sync flush so the chunks join on byte
+ * boundaries, and the Adler-32 of the whole input is rebuilt from the chunk
+ * checksums. The result is one ordinary zlib stream, accepted by the stub.
+ *
+ * plan_deflate() samples an image and decides whether deflate pays off at
+ * the given baud rate and which level gives the shortest compress + send
+ * time. High entropy data (encrypted or already compressed partitions) is
+ * sent raw.
+ *
+ ******************************************************************************
+ */
+
+#ifndef ESP_COMPRESS_H
+#define ESP_COMPRESS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class DeflateBackend
+{
+public:
+    virtual ~DeflateBackend() = default;
+    virtual const char* name() const = 0;
+    virtual std::vector<uint8_t> compress(const std::vector<uint8_t>& source, int level) const = 0;
+};
+
+const std::vector<const DeflateBackend*>& deflate_backends();
+const DeflateBackend& deflate_backend();
+bool select_deflate_backend(const std::string& name);
+
+struct DeflatePlan {
+    bool compress = true;
+    int level = 9;
+    double entropy = 0;         // bits per byte over the samples
+    double ratio = 1;           // estimated output/input at the chosen level
+    double estimated_ms = 0;    // estimated compress + wire time
+};
+
+std::vector<uint8_t> compress_vector(const std::vector<uint8_t>& source, int level = 9);
+std::vector<uint8_t> compress_vector_parallel(const std::vector<uint8_t>& source, int level = 9,
+                                              unsigned threads = 0, size_t chunk_size = 64 * 1024);
+DeflatePlan plan_deflate(const std::vector<uint8_t>& data, uint32_t baud, unsigned threads = 0);
+
+#endif // ESP_COMPRESS_H
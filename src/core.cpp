@@ -16,6 +16,8 @@
 
 #include <QString>
 #include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QMetaMethod>
 
 #include <QDEbug>
 #include <iostream>
@@ -40,6 +42,7 @@ using SlipReply = EspToolQt::SlipReply;
 
 EspToolQt::EspToolQt(QObject *parent) : QObject {parent} {
     serial = new QSerialPort(this);
+    serial_transport_.reset(new EspSerialTransport(serial));
     //available_targets
     available_targets.push_back(new Esp8266(parent));
     available_targets.push_back(new Esp32(parent));
@@ -55,6 +58,14 @@ EspToolQt::EspToolQt(QObject *parent) : QObject {parent} {
 }
 
 uint32_t EspToolQt::read_reg(uint32_t address) {
+    return readRegTimed(address, ESP_READ_REG);
+}
+
+// read_reg() whose reply time is learned under reply_class, for reads that
+// wait on more than the register itself.
+uint32_t EspToolQt::readRegTimed(uint32_t address, int reply_class) {
+    EspTrace::Span span = traceSpan("read_reg", "command");
+    span.arg("address", address);
     vector<uint8_t> address_vec;
     address_vec.push_back(address);
     address_vec.push_back(address >> 8);
@@ -62,8 +73,12 @@ uint32_t EspToolQt::read_reg(uint32_t address) {
     address_vec.push_back(address >> 24);
 
     vector<uint8_t> slip = slip_encode(0x0a, address_vec);
+    const quint64 wire_bytes = slip.size() + ESP_REPLY_WIRE_BYTES;
+    QElapsedTimer timer;
+    timer.start();
     serialWrite(slip);
-    vector<uint8_t> reply = serialReadOneFrame();
+    vector<uint8_t> reply = serialReadOneFrame(replyTimeout(reply_class, 1000, wire_bytes));
+    replySample(reply_class, timer.elapsed(), wire_bytes, !reply.empty());
 
     SlipReply slip_reply = slip_parse(reply);
     if (slip_reply.valid) {
@@ -123,6 +138,72 @@ void EspToolQt::progress(float progress) {
     }
 }
 
+// Report read progress. Segmented reads set read_progress_base_ and
+// read_progress_total_ so every segment moves one bar across the whole read.
+void EspToolQt::readProgress(quint64 done, quint64 total) {
+    if (read_progress_total_ != 0) {
+        done += read_progress_base_;
+        total = read_progress_total_;
+    }
+    reportProgress(done, total);
+}
+
+bool EspProgressThrottle::update(quint64 done, quint64 total, Clock::time_point now) {
+    const bool restarted = done == 0 || total != total_ || done < last_done_;
+    if (restarted) {
+        total_ = total;
+        start_ = now;
+        last_emit_ = Clock::time_point();
+        next_bytes_ = 0;
+        emitted_done_ = static_cast<quint64>(-1);
+    }
+    last_done_ = done;
+    return restarted;
+}
+
+bool EspProgressThrottle::due(quint64 done, quint64 total, float min_step, int max_rate_hz, Clock::time_point now) {
+    const bool final = done >= total;
+    if (final && emitted_done_ == done) return false;
+    if (!final && done < next_bytes_) return false;
+    if (!final && max_rate_hz > 0 && now - last_emit_ < std::chrono::milliseconds(1000 / max_rate_hz)) return false;
+    last_emit_ = now;
+    next_bytes_ = done + static_cast<quint64>(total * min_step / 100);
+    emitted_done_ = done;
+    return true;
+}
+
+// Coalesce progress updates. Reads call this once per frame, so only the
+// updates progress_throttle_ lets through are emitted. Listeners are looked
+// up once per operation, with none connected the call returns right after
+// the bookkeeping.
+void EspToolQt::reportProgress(quint64 done, quint64 total) {
+    using namespace std::chrono;
+    const steady_clock::time_point now = steady_clock::now();
+    if (progress_throttle_.update(done, total, now)) {
+        progress_listeners_ = serial_progress_enabled
+            || (progress_signal_enabled && isSignalConnected(QMetaMethod::fromSignal(&EspToolQt::progress_signal)))
+            || (progress_bytes_enabled && isSignalConnected(QMetaMethod::fromSignal(&EspToolQt::progress_bytes_signal)))
+            || isSignalConnected(QMetaMethod::fromSignal(&EspToolQt::progress_info_signal));
+    }
+    if (!progress_listeners_) return;
+    if (!progress_throttle_.due(done, total, progress_min_step, progress_max_rate_hz, now)) return;
+
+    EspProgress info;
+    info.done = done;
+    info.total = total;
+    info.percent = total == 0 ? 100 : (float)done / (float)total * 100;
+    const double elapsed_s = duration<double>(now - progress_throttle_.started()).count();
+    if (elapsed_s > 0 && done != 0) {
+        info.bytes_per_second = done / elapsed_s;
+        info.eta_ms = static_cast<qint64>((total > done ? total - done : 0) / info.bytes_per_second * 1000);
+    }
+
+    progress(info.percent);
+    if (progress_bytes_enabled)
+        emit progress_bytes_signal(done, total);
+    emit progress_info_signal(info);
+}
+
 uint32_t EspToolQt::flashSizeIdToBytes (uint8_t size_id) {
     uint32_t flash_size;
     std::map<uint8_t, uint32_t>::iterator flash_size_iter;
@@ -159,10 +240,14 @@ uint32_t EspToolQt::flashSizeIdToBytes (uint8_t size_id) {
     return flash_size_iter->second;
 }
 
-uint32_t EspToolQt::getFlashSize() {
+// JEDEC ID of the SPI flash: manufacturer in bits 0-7, device in bits 8-23
+uint32_t EspToolQt::getFlashId() {
     const uint8_t SPIFLASH_RDID = 0x9f;
+    return runSpiFlashCommand(SPIFLASH_RDID, {}, 24);
+}
 
-    uint32_t flash_id = runSpiFlashCommand(SPIFLASH_RDID, {}, 24);
+uint32_t EspToolQt::getFlashSize() {
+    uint32_t flash_id = getFlashId();
     uint32_t size_id = flash_id >> 16;
     uint32_t flash_size_bytes = flashSizeIdToBytes(size_id);
     double flash_size_megabytes = (double)flash_size_bytes / 1024 / 1024;
@@ -175,3 +260,41 @@ uint32_t EspToolQt::getFlashSize() {
 uint32_t EspToolQt::readEfuse(uint8_t n) {
     return read_reg(target->EFUSE_RD_REG_BASE() + (4 * n));
 }
+
+#ifdef KT_SELFTEST
+#include "kt_selftest/kt_selftest.h"
+
+KT_TEST(esp_progress_throttle_limits_rate,
+        "updates wait for the rate limit and the minimum step") {
+    using std::chrono::milliseconds;
+    EspProgressThrottle throttle;
+    const EspProgressThrottle::Clock::time_point t0 = EspProgressThrottle::Clock::now();
+    KT_ASSERT(throttle.update(0, 1000, t0));
+    KT_ASSERT(throttle.due(0, 1000, 0.5f, 20, t0));
+
+    KT_ASSERT(!throttle.update(100, 1000, t0 + milliseconds(10)));
+    KT_ASSERT(!throttle.due(100, 1000, 0.5f, 20, t0 + milliseconds(10)));
+    KT_ASSERT(throttle.due(100, 1000, 0.5f, 20, t0 + milliseconds(60)));
+
+    // 0.5 % of 1000 bytes: the next update needs 5 more bytes
+    KT_ASSERT(!throttle.due(103, 1000, 0.5f, 0, t0 + milliseconds(200)));
+    KT_ASSERT(throttle.due(105, 1000, 0.5f, 0, t0 + milliseconds(200)));
+}
+
+KT_TEST(esp_progress_throttle_sends_final_once,
+        "the final update bypasses the limits once, a new operation starts over") {
+    using std::chrono::milliseconds;
+    EspProgressThrottle throttle;
+    const EspProgressThrottle::Clock::time_point t0 = EspProgressThrottle::Clock::now();
+    throttle.update(0, 1000, t0);
+    KT_ASSERT(throttle.due(0, 1000, 0.5f, 20, t0));
+    throttle.update(1000, 1000, t0 + milliseconds(1));
+    KT_ASSERT(throttle.due(1000, 1000, 0.5f, 20, t0 + milliseconds(1)));
+    KT_ASSERT(!throttle.due(1000, 1000, 0.5f, 20, t0 + milliseconds(100)));
+
+    KT_ASSERT(throttle.update(0, 2000, t0 + milliseconds(2)));
+    KT_ASSERT(throttle.due(0, 2000, 0.5f, 20, t0 + milliseconds(2)));
+    KT_ASSERT(throttle.started() == t0 + milliseconds(2));
+}
+
+#endif // KT_SELFTEST
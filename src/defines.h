@@ -45,4 +45,21 @@
 #define  ESP_FLASH_DEFL_END   0x12
 #define  ESP_READ_REG         0x0A
 
+// Commands supported by ESP32 ROM bootloader and the flasher stub
+#define  ESP_SPI_FLASH_MD5    0x13
+
+// Commands supported only by the flasher stub
+#define  ESP_ERASE_FLASH      0xD0
+#define  ESP_ERASE_REGION     0xD1
+
+// Error codes of a failed reply that mean the command is not known
+#define  ESP_ERROR_INVALID_MESSAGE     0x05    // ROM bootloader
+#define  ESP_ERROR_CMD_NOT_IMPLEMENTED 0xFF    // flasher stub
+
+// Reply timeout estimation
+#define  ESP_REPLY_WIRE_BYTES     14      // smallest framed response
+#define  ESP_RTO_STUB_GREETING    0x106   // "OHAI" of a stub started by mem_end
+#define  ESP_RTO_FLASH_FINAL_WAIT 0x10A   // read_reg behind the last flash write, not a plain read
+#define  ESP_RTO_READ_FRAME       0x1D2   // one frame of a stop-and-wait flash read
+
 #endif // ESP_TOOL_QT_DEFINES_H
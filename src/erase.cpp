@@ -0,0 +1,234 @@
+/**
+ ******************************************************************************
+ * @file           : src/erase.cpp
+ * @brief          : Implements flash region and chip erase.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ * @details
+ *
+ * The stub erase commands are used first. If the stub refuses them, the
+ * range is erased with plain SPI flash commands through runSpiFlashCommand,
+ * choosing 64 KB block, 32 KB block or 4 KB sector erase per sub-range so
+ * the number of erase commands stays minimal.
+ *
+ ******************************************************************************
+ */
+
+#include "../esptoolqt.h"
+#include "defines.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QThread>
+
+#include <cmath>
+
+using std::vector;
+
+namespace {
+
+// SPI flash commands
+const uint32_t SPIFLASH_WREN        = 0x06;
+const uint32_t SPIFLASH_RDSR        = 0x05;
+const uint32_t SPIFLASH_SE_4K       = 0x20;
+const uint32_t SPIFLASH_BE_32K      = 0x52;
+const uint32_t SPIFLASH_BE_64K      = 0xD8;
+const uint32_t SPIFLASH_CHIP_ERASE  = 0xC7;
+const uint32_t SPIFLASH_STATUS_WIP  = 0x01;
+
+const uint32_t CHIP_ERASE_TIMEOUT_MS = 120000;
+
+struct EraseStep { uint32_t command; uint32_t address; uint32_t size; int typical_ms; int timeout_ms; };
+
+// Largest erase granularity that fits at every position of the range.
+vector<EraseStep> planErase(uint32_t offset, uint32_t size) {
+    vector<EraseStep> plan;
+    const uint32_t end = offset + size;
+    uint32_t address = offset;
+    while (address < end) {
+        const uint32_t left = end - address;
+        if (address % 0x10000 == 0 && left >= 0x10000) {
+            plan.push_back({SPIFLASH_BE_64K, address, 0x10000, 150, 2000});
+        } else if (address % 0x8000 == 0 && left >= 0x8000) {
+            plan.push_back({SPIFLASH_BE_32K, address, 0x8000, 120, 1600});
+        } else {
+            plan.push_back({SPIFLASH_SE_4K, address, 0x1000, 45, 400});
+        }
+        address += plan.back().size;
+    }
+    return plan;
+}
+
+double kbytePerSecond(quint64 bytes, qint64 duration_ms)
+{
+    if (duration_ms <= 0) duration_ms = 1;
+    return (static_cast<double>(bytes) / 1024.0) / (static_cast<double>(duration_ms) / 1000.0);
+}
+
+}
+
+// Poll the flash status register until the write-in-progress bit clears.
+// The first poll waits for the typical erase time, so a fast erase usually
+// needs one status read only.
+bool EspToolQt::spiFlashWaitIdle(int typical_ms, int timeout_ms) {
+    QElapsedTimer timer;
+    timer.start();
+    QThread::msleep(typical_ms);
+    int poll_ms = std::max(1, typical_ms / 4);
+    while (true) {
+        if (isCancelled()) {
+            closePort();
+            return false;
+        }
+        const uint32_t status = runSpiFlashCommand(SPIFLASH_RDSR, {}, 8);
+        if ((status & SPIFLASH_STATUS_WIP) == 0) return true;
+        if (timer.elapsed() > timeout_ms) break;
+        QThread::msleep(poll_ms);
+    }
+    qInfo() << "[ERROR] SPI flash stays busy after erase";
+    return false;
+}
+
+bool EspToolQt::spiFlashErase(uint32_t command, uint32_t address, int typical_ms, int timeout_ms) {
+    runSpiFlashCommand(SPIFLASH_WREN);
+    if (command == SPIFLASH_CHIP_ERASE) {
+        runSpiFlashCommand(command);
+    } else {
+        runSpiFlashCommand(command, {}, 0, address, 24);
+    }
+    return spiFlashWaitIdle(typical_ms, timeout_ms);
+}
+
+// True when the stub erased, or explicitly refused the command so SPI flash
+// commands may take over. Without a reply the erase may still be running
+// and the link is out of step, so give up instead of sending more.
+bool EspToolQt::stubEraseUsable(CommandStatus status, const char* what) {
+    if (status == CommandStatus::Ok || status == CommandStatus::Unsupported) return true;
+    if (status == CommandStatus::NoReply) {
+        serialDrain(100, 2000);
+        qInfo() << "[ERROR]" << what << "got no reply from the stub";
+    } else {
+        qInfo() << "[ERROR]" << what << "failed";
+    }
+    return false;
+}
+
+bool EspToolQt::eraseRegion(uint32_t memory_offset, uint32_t size) {
+    QElapsedTimer timer;
+    timer.start();
+
+    // check that target is connected
+    if (target == NULL || !io()->isOpen()) {
+        qInfo() << "[Error] Target is not connected";
+        return false;
+    }
+
+    const uint32_t sector_size = target->FLASH_SECTOR_SIZE();
+    if (memory_offset % sector_size != 0 || size % sector_size != 0) {
+        qInfo().noquote() << QString("[ERROR] Erase range [0x%1-0x%2] is not aligned to flash sector size")
+            .arg(QString::number(memory_offset, 16).toUpper())
+            .arg(QString::number(memory_offset + size, 16).toUpper());
+        return false;
+    }
+    if (size == 0) return true;
+
+    readProgress(0, size);
+    const CommandStatus status = stubEraseRegion(memory_offset, size);
+    if (isCancelled()) {
+        closePort();
+        return false;
+    }
+    if (!stubEraseUsable(status, "Erase")) return false;
+    const bool via_stub = status == CommandStatus::Ok;
+
+    uint32_t commands = 1;
+    if (!via_stub) {
+        qInfo() << "[WARNING] Stub erase not supported, erasing through SPI flash commands";
+        const vector<EraseStep> plan = planErase(memory_offset, size);
+        commands = plan.size();
+        uint32_t done = 0;
+        for (const EraseStep& step : plan) {
+            if (!spiFlashErase(step.command, step.address, step.typical_ms, step.timeout_ms)) {
+                qInfo().noquote() << QString("[ERROR] Erase failed at 0x%1")
+                    .arg(QString::number(step.address, 16).toUpper());
+                return false;
+            }
+            done += step.size;
+            readProgress(done, size);
+        }
+    }
+    readProgress(size, size);
+
+    const qint64 elapsed_ms = timer.elapsed();
+    qInfo().noquote() << QString("[OK] Erased %1 bytes in %2 ms (%3 KB/s)")
+        .arg(size).arg(elapsed_ms).arg(kbytePerSecond(size, elapsed_ms), 0, 'f', 1);
+    if (isDiagEnabled()) {
+        qInfo().noquote() << QString("[esp-diag] eraseRegion offset=0x%1 size=%2 via=%3 commands=%4 total_ms=%5")
+            .arg(QString::number(memory_offset, 16).toUpper())
+            .arg(size)
+            .arg(via_stub ? "stub" : "spi")
+            .arg(commands)
+            .arg(elapsed_ms);
+    }
+    return true;
+}
+
+bool EspToolQt::eraseFlash() {
+    QElapsedTimer timer;
+    timer.start();
+
+    // check that target is connected
+    if (target == NULL || !io()->isOpen()) {
+        qInfo() << "[Error] Target is not connected";
+        return false;
+    }
+
+    const CommandStatus status = slipCommandStatus(ESP_ERASE_FLASH, {}, 0, CHIP_ERASE_TIMEOUT_MS);
+    if (isCancelled()) {
+        closePort();
+        return false;
+    }
+    if (!stubEraseUsable(status, "Chip erase")) return false;
+    const bool via_stub = status == CommandStatus::Ok;
+    if (!via_stub) {
+        qInfo() << "[WARNING] Stub erase not supported, erasing through SPI flash commands";
+        if (!spiFlashErase(SPIFLASH_CHIP_ERASE, 0, 1000, CHIP_ERASE_TIMEOUT_MS)) {
+            qInfo() << "[ERROR] Chip erase failed";
+            return false;
+        }
+    }
+
+    const qint64 elapsed_ms = timer.elapsed();
+    const quint64 flash_size = esp_target_info.flash_size;
+    qInfo().noquote() << QString("[OK] Chip erased in %1 ms (%2 KB/s)")
+        .arg(elapsed_ms).arg(kbytePerSecond(flash_size, elapsed_ms), 0, 'f', 1);
+    if (isDiagEnabled()) {
+        qInfo().noquote() << QString("[esp-diag] eraseFlash size=%1 via=%2 total_ms=%3")
+            .arg(flash_size)
+            .arg(via_stub ? "stub" : "spi")
+            .arg(elapsed_ms);
+    }
+    return true;
+}
+
+#ifdef KT_SELFTEST
+#include "kt_selftest/kt_selftest.h"
+
+KT_TEST(esp_erase_plan_uses_largest_blocks,
+        "erase plan picks 64K/32K blocks where aligned and 4K sectors at the edges") {
+    const vector<EraseStep> plan = planErase(0x7000, 0x19000);
+    KT_ASSERT_EQ(plan.size(), static_cast<size_t>(3));
+    KT_ASSERT_EQ(plan[0].command, SPIFLASH_SE_4K);
+    KT_ASSERT_EQ(plan[1].command, SPIFLASH_BE_32K);
+    KT_ASSERT_EQ(plan[1].address, 0x8000u);
+    KT_ASSERT_EQ(plan[2].command, SPIFLASH_BE_64K);
+    KT_ASSERT_EQ(plan[2].address, 0x10000u);
+}
+
+#endif // KT_SELFTEST
@@ -0,0 +1,187 @@
+/**
+ ******************************************************************************
+ * @file           : src/flash_journal.cpp
+ * @brief          : Implements the on-disk journal for resumable flash jobs.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ */
+
+#include "flash_journal.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QStringList>
+
+bool EspFlashJournal::load(const QString &path)
+{
+    ranges.clear();
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QJsonParseError error;
+    const QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &error);
+    if (error.error != QJsonParseError::NoError || !document.isObject()) {
+        qInfo() << "[WARNING] Ignoring unreadable flash journal" << path << error.errorString();
+        return false;
+    }
+
+    const QJsonObject root = document.object();
+    kind = root.value(QStringLiteral("kind")).toString();
+    mac = root.value(QStringLiteral("mac")).toString();
+    flash_id = static_cast<uint32_t>(root.value(QStringLiteral("flash_id")).toDouble());
+    offset = static_cast<uint32_t>(root.value(QStringLiteral("offset")).toDouble());
+    size = static_cast<uint32_t>(root.value(QStringLiteral("size")).toDouble());
+    chunk_size = static_cast<uint32_t>(root.value(QStringLiteral("chunk_size")).toDouble());
+    image_md5 = QByteArray::fromHex(root.value(QStringLiteral("image_md5")).toString().toLatin1());
+
+    const QJsonArray json_ranges = root.value(QStringLiteral("ranges")).toArray();
+    for (const QJsonValue &value : json_ranges) {
+        const QJsonObject object = value.toObject();
+        Range range;
+        range.offset = static_cast<uint32_t>(object.value(QStringLiteral("offset")).toDouble());
+        range.size = static_cast<uint32_t>(object.value(QStringLiteral("size")).toDouble());
+        range.md5 = QByteArray::fromHex(object.value(QStringLiteral("md5")).toString().toLatin1());
+        ranges.push_back(range);
+    }
+    return true;
+}
+
+bool EspFlashJournal::save(const QString &path) const
+{
+    QJsonArray json_ranges;
+    for (const Range &range : ranges) {
+        QJsonObject object;
+        object.insert(QStringLiteral("offset"), static_cast<double>(range.offset));
+        object.insert(QStringLiteral("size"), static_cast<double>(range.size));
+        object.insert(QStringLiteral("md5"), QString::fromLatin1(range.md5.toHex()));
+        json_ranges.append(object);
+    }
+
+    QJsonObject root;
+    root.insert(QStringLiteral("kind"), kind);
+    root.insert(QStringLiteral("mac"), mac);
+    root.insert(QStringLiteral("flash_id"), static_cast<double>(flash_id));
+    root.insert(QStringLiteral("offset"), static_cast<double>(offset));
+    root.insert(QStringLiteral("size"), static_cast<double>(size));
+    root.insert(QStringLiteral("chunk_size"), static_cast<double>(chunk_size));
+    root.insert(QStringLiteral("image_md5"), QString::fromLatin1(image_md5.toHex()));
+    root.insert(QStringLiteral("ranges"), json_ranges);
+
+    // write to a temporary file and rename, so a crash never leaves a torn journal
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qInfo() << "[ERROR] Can't write flash journal" << path << file.errorString();
+        return false;
+    }
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
+
+bool EspFlashJournal::sameJob(const EspFlashJournal &other) const
+{
+    return kind == other.kind
+        && !mac.isEmpty() && mac == other.mac
+        && flash_id == other.flash_id
+        && offset == other.offset
+        && size == other.size
+        && chunk_size == other.chunk_size
+        && image_md5 == other.image_md5;
+}
+
+const EspFlashJournal::Range *EspFlashJournal::findRange(uint32_t range_offset, uint32_t range_size) const
+{
+    for (const Range &range : ranges) {
+        if (range.offset == range_offset && range.size == range_size) return &range;
+    }
+    return nullptr;
+}
+
+bool EspFlashJournal::hasRange(uint32_t range_offset, uint32_t range_size) const
+{
+    return findRange(range_offset, range_size) != nullptr;
+}
+
+void EspFlashJournal::addRange(uint32_t range_offset, uint32_t range_size, const QByteArray &md5)
+{
+    for (Range &range : ranges) {
+        if (range.offset == range_offset && range.size == range_size) {
+            range.md5 = md5;
+            return;
+        }
+    }
+    ranges.push_back({range_offset, range_size, md5});
+}
+
+quint64 EspFlashJournal::completedBytes() const
+{
+    quint64 bytes = 0;
+    for (const Range &range : ranges) bytes += range.size;
+    return bytes;
+}
+
+QString EspFlashJournal::macToString(const std::vector<uint8_t> &mac)
+{
+    QStringList parts;
+    for (uint8_t byte : mac) {
+        parts.push_back(QString::number(byte, 16).toUpper().rightJustified(2, '0'));
+    }
+    return parts.join(QStringLiteral(":"));
+}
+
+#ifdef KT_SELFTEST
+#include "kt_selftest/kt_selftest.h"
+
+KT_TEST(esp_flash_journal_same_job_requires_device_and_layout,
+        "EspFlashJournal only resumes the same device, range and chunk layout") {
+    EspFlashJournal a;
+    a.kind = QStringLiteral("read");
+    a.mac = QStringLiteral("24:0A:C4:00:00:01");
+    a.flash_id = 0x1840EF;
+    a.offset = 0;
+    a.size = 0x400000;
+    a.chunk_size = 0x40000;
+
+    EspFlashJournal b = a;
+    KT_ASSERT(a.sameJob(b));
+
+    b.flash_id = 0x1640EF;
+    KT_ASSERT(!a.sameJob(b));
+
+    b = a;
+    b.chunk_size = 0x10000;
+    KT_ASSERT(!a.sameJob(b));
+
+    b = a;
+    a.mac.clear();
+    b.mac.clear();
+    KT_ASSERT(!a.sameJob(b));
+}
+
+KT_TEST(esp_flash_journal_ranges_are_unique,
+        "EspFlashJournal addRange replaces an existing range instead of duplicating it") {
+    EspFlashJournal journal;
+    journal.addRange(0x0, 0x1000, QByteArray("a"));
+    journal.addRange(0x1000, 0x1000, QByteArray("b"));
+    journal.addRange(0x0, 0x1000, QByteArray("c"));
+
+    KT_ASSERT_EQ(journal.ranges.size(), static_cast<size_t>(2));
+    KT_ASSERT(journal.hasRange(0x1000, 0x1000));
+    KT_ASSERT(!journal.hasRange(0x2000, 0x1000));
+    KT_ASSERT(journal.findRange(0x0, 0x1000)->md5 == QByteArray("c"));
+    KT_ASSERT_EQ(journal.completedBytes(), static_cast<quint64>(0x2000));
+}
+
+#endif // KT_SELFTEST
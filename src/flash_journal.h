@@ -0,0 +1,69 @@
+/**
+ ******************************************************************************
+ * @file           : src/flash_journal.h
+ * @brief          : Declares the on-disk journal for resumable flash jobs.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ * @details
+ *
+ * Records which ranges of a long flash read or write already completed and
+ * passed an MD5 check, so an interrupted job can pick up where it stopped.
+ * A journal is bound to one device (base MAC and SPI flash JEDEC ID) and one
+ * job layout (offset, size, chunk size); anything else starts from scratch.
+ *
+ * Usage Example:
+ * ```cpp
+ * EspFlashJournal journal;
+ * journal.load(path + ".journal");
+ * if (!journal.hasRange(chunk_offset, chunk_size)) { ... }
+ * ```
+ *
+ ******************************************************************************
+ */
+
+#ifndef ESP_FLASH_JOURNAL_H
+#define ESP_FLASH_JOURNAL_H
+
+#include <cstdint>
+#include <vector>
+
+#include <QByteArray>
+#include <QString>
+
+class EspFlashJournal
+{
+public:
+    struct Range {
+        uint32_t offset = 0;
+        uint32_t size = 0;
+        QByteArray md5;
+    };
+
+    QString kind;            // "read" or "write"
+    QString mac;
+    uint32_t flash_id = 0;
+    uint32_t offset = 0;
+    uint32_t size = 0;
+    uint32_t chunk_size = 0;
+    QByteArray image_md5;    // write journals: MD5 of the whole image
+    std::vector<Range> ranges;
+
+    bool load(const QString &path);
+    bool save(const QString &path) const;
+
+    bool sameJob(const EspFlashJournal &other) const;
+    bool hasRange(uint32_t range_offset, uint32_t range_size) const;
+    const Range *findRange(uint32_t range_offset, uint32_t range_size) const;
+    void addRange(uint32_t range_offset, uint32_t range_size, const QByteArray &md5);
+    quint64 completedBytes() const;
+
+    static QString macToString(const std::vector<uint8_t> &mac);
+};
+
+#endif // ESP_FLASH_JOURNAL_H
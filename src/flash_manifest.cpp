@@ -0,0 +1,239 @@
+/**
+ ******************************************************************************
+ * @file           : src/flash_manifest.cpp
+ * @brief          : Implements the multi-image flash manifest.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ */
+
+#include "flash_manifest.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+
+#include <algorithm>
+
+namespace {
+
+bool parseOffset(const QString &text, uint32_t *offset)
+{
+    bool ok = false;
+    *offset = text.trimmed().toUInt(&ok, 0);
+    return ok;
+}
+
+}
+
+bool EspFlashManifest::load(const QString &path)
+{
+    images.clear();
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qInfo() << "[ERROR] Can't open flash manifest" << path << file.errorString();
+        return false;
+    }
+    const QByteArray content = file.readAll();
+    const QString base_dir = QFileInfo(path).absolutePath();
+
+    if (content.trimmed().startsWith('{')) {
+        return loadFlasherArgs(content, base_dir);
+    }
+    return loadList(content, base_dir);
+}
+
+// ESP-IDF build/flasher_args.json: {"flash_files": {"0x1000": "bootloader/bootloader.bin", ...}}
+bool EspFlashManifest::loadFlasherArgs(const QByteArray &content, const QString &base_dir)
+{
+    QJsonParseError error;
+    const QJsonDocument document = QJsonDocument::fromJson(content, &error);
+    if (error.error != QJsonParseError::NoError || !document.isObject()) {
+        qInfo() << "[ERROR] Unreadable flash manifest" << error.errorString();
+        return false;
+    }
+
+    const QJsonObject files = document.object().value(QStringLiteral("flash_files")).toObject();
+    if (files.isEmpty()) {
+        qInfo() << "[ERROR] Flash manifest has no flash_files";
+        return false;
+    }
+    for (auto it = files.constBegin(); it != files.constEnd(); ++it) {
+        uint32_t offset = 0;
+        if (!parseOffset(it.key(), &offset)) {
+            qInfo() << "[ERROR] Bad offset in flash manifest:" << it.key();
+            return false;
+        }
+        if (!addImage(offset, QDir(base_dir).filePath(it.value().toString()))) return false;
+    }
+    return true;
+}
+
+// Plain list, one "<offset> <file>" per line, '#' starts a comment.
+bool EspFlashManifest::loadList(const QByteArray &content, const QString &base_dir)
+{
+    const QStringList lines = QString::fromUtf8(content).split('\n');
+    for (int i = 0; i < lines.size(); i++) {
+        const QString line = lines[i].section('#', 0, 0).trimmed();
+        if (line.isEmpty()) continue;
+
+        int split = 0;
+        while (split < line.size() && !line[split].isSpace()) split++;
+        uint32_t offset = 0;
+        if (split == line.size() || !parseOffset(line.left(split), &offset)) {
+            qInfo() << "[ERROR] Bad flash manifest line" << (i + 1) << ":" << lines[i];
+            return false;
+        }
+        if (!addImage(offset, QDir(base_dir).filePath(line.mid(split).trimmed()))) return false;
+    }
+    if (images.empty()) {
+        qInfo() << "[ERROR] Flash manifest is empty";
+        return false;
+    }
+    return true;
+}
+
+bool EspFlashManifest::addImage(uint32_t offset, const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qInfo() << "[ERROR] Can't open image" << path << file.errorString();
+        return false;
+    }
+    const QByteArray content = file.readAll();
+    Image image;
+    image.offset = offset;
+    image.path = path;
+    image.data.assign(content.begin(), content.end());
+    images.push_back(image);
+    return true;
+}
+
+void EspFlashManifest::addImage(uint32_t offset, const std::vector<uint8_t> &data, const QString &name)
+{
+    Image image;
+    image.offset = offset;
+    image.path = name;
+    image.data = data;
+    images.push_back(image);
+}
+
+// Images must not overlap once padded to the 4 byte write granularity.
+bool EspFlashManifest::validate() const
+{
+    std::vector<const Image*> sorted;
+    for (const Image &image : images) sorted.push_back(&image);
+    std::sort(sorted.begin(), sorted.end(), [](const Image *a, const Image *b) { return a->offset < b->offset; });
+
+    for (size_t i = 0; i < sorted.size(); i++) {
+        if (sorted[i]->offset % 4 != 0) {
+            qInfo().noquote() << QString("[ERROR] Image %1 offset 0x%2 is not 4 byte aligned")
+                .arg(sorted[i]->path).arg(QString::number(sorted[i]->offset, 16).toUpper());
+            return false;
+        }
+        if (i == 0) continue;
+        const quint64 previous_end = static_cast<quint64>(sorted[i - 1]->offset) + ((sorted[i - 1]->data.size() + 3) & ~size_t(3));
+        if (previous_end > sorted[i]->offset) {
+            qInfo().noquote() << QString("[ERROR] Image %1 at 0x%2 overlaps %3 ending at 0x%4")
+                .arg(sorted[i]->path).arg(QString::number(sorted[i]->offset, 16).toUpper())
+                .arg(sorted[i - 1]->path).arg(QString::number(previous_end, 16).toUpper());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Sorted images padded to 4 bytes. Images that touch or share a flash
+// sector are merged, with 0xFF in between: flash begin erases whole
+// sectors, so writing them apart would erase the bytes of the other one.
+std::vector<EspFlashManifest::Extent> EspFlashManifest::extents(uint32_t sector_size) const
+{
+    std::vector<const Image*> sorted;
+    for (const Image &image : images) {
+        if (!image.data.empty()) sorted.push_back(&image);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const Image *a, const Image *b) { return a->offset < b->offset; });
+
+    std::vector<Extent> result;
+    for (const Image *image : sorted) {
+        const bool shares_sector = !result.empty() && image->offset
+            < (result.back().offset + result.back().data.size() + sector_size - 1) / sector_size * sector_size;
+        if (!shares_sector) {
+            Extent extent;
+            extent.offset = image->offset;
+            result.push_back(extent);
+        }
+        Extent &extent = result.back();
+        extent.data.resize(image->offset - extent.offset, 0xFF);
+        extent.data.insert(extent.data.end(), image->data.begin(), image->data.end());
+        extent.data.resize((extent.data.size() + 3) & ~size_t(3), 0xFF);
+        extent.images++;
+    }
+    return result;
+}
+
+quint64 EspFlashManifest::totalBytes(uint32_t sector_size) const
+{
+    quint64 total = 0;
+    for (const Extent &extent : extents(sector_size)) total += extent.data.size();
+    return total;
+}
+
+#ifdef KT_SELFTEST
+#include "kt_selftest/kt_selftest.h"
+
+KT_TEST(esp_flash_manifest_merges_adjacent_images,
+        "back to back images become one extent, gaps keep separate extents") {
+    EspFlashManifest manifest;
+    manifest.addImage(0x9000, std::vector<uint8_t>(0x1000, 0x11), QStringLiteral("app"));
+    manifest.addImage(0x8000, std::vector<uint8_t>(0x1000, 0x22), QStringLiteral("partitions"));
+    manifest.addImage(0x1000, std::vector<uint8_t>(0x6001, 0x33), QStringLiteral("bootloader"));
+    KT_ASSERT(manifest.validate());
+
+    const std::vector<EspFlashManifest::Extent> extents = manifest.extents();
+    KT_ASSERT_EQ(extents.size(), static_cast<size_t>(2));
+    KT_ASSERT_EQ(extents[0].offset, 0x1000u);
+    KT_ASSERT_EQ(extents[0].data.size(), static_cast<size_t>(0x6004));
+    KT_ASSERT_EQ(extents[1].offset, 0x8000u);
+    KT_ASSERT_EQ(extents[1].images, 2);
+}
+
+KT_TEST(esp_flash_manifest_rejects_overlap,
+        "overlapping images fail validation") {
+    EspFlashManifest manifest;
+    manifest.addImage(0x1000, std::vector<uint8_t>(0x7001, 0x33), QStringLiteral("bootloader"));
+    manifest.addImage(0x8000, std::vector<uint8_t>(0x1000, 0x22), QStringLiteral("partitions"));
+    KT_ASSERT(!manifest.validate());
+}
+
+KT_TEST(esp_flash_manifest_merges_shared_sector,
+        "images in the same flash sector become one extent padded with 0xFF") {
+    EspFlashManifest manifest;
+    manifest.addImage(0x1000, std::vector<uint8_t>(0x102, 0x11), QStringLiteral("first"));
+    manifest.addImage(0x1800, std::vector<uint8_t>(0x100, 0x22), QStringLiteral("second"));
+    manifest.addImage(0x3000, std::vector<uint8_t>(0x100, 0x33), QStringLiteral("third"));
+    KT_ASSERT(manifest.validate());
+
+    const std::vector<EspFlashManifest::Extent> extents = manifest.extents(0x1000);
+    KT_ASSERT_EQ(extents.size(), static_cast<size_t>(2));
+    KT_ASSERT_EQ(extents[0].offset, 0x1000u);
+    KT_ASSERT_EQ(extents[0].images, 2);
+    KT_ASSERT_EQ(extents[0].data.size(), static_cast<size_t>(0x900));
+    KT_ASSERT_EQ(extents[0].data[0x101], static_cast<uint8_t>(0x11));
+    KT_ASSERT_EQ(extents[0].data[0x102], static_cast<uint8_t>(0xFF));
+    KT_ASSERT_EQ(extents[0].data[0x7FF], static_cast<uint8_t>(0xFF));
+    KT_ASSERT_EQ(extents[0].data[0x800], static_cast<uint8_t>(0x22));
+    KT_ASSERT_EQ(extents[1].offset, 0x3000u);
+}
+
+#endif // KT_SELFTEST
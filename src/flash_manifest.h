@@ -0,0 +1,70 @@
+/**
+ ******************************************************************************
+ * @file           : src/flash_manifest.h
+ * @brief          : Declares the multi-image flash manifest.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ * @details
+ *
+ * A manifest is the list of images that make up one production flash:
+ * bootloader, partition table, otadata, application, file system... It is
+ * filled in code or loaded from either an ESP-IDF `flasher_args.json` or a
+ * plain text list with one "<offset> <file>" pair per line. Relative file
+ * names are resolved against the manifest location.
+ *
+ * Usage Example:
+ * ```cpp
+ * EspFlashManifest manifest;
+ * if (manifest.load("build/flasher_args.json") && manifest.validate())
+ *     tool.flashManifest(manifest);
+ * ```
+ *
+ ******************************************************************************
+ */
+
+#ifndef ESP_FLASH_MANIFEST_H
+#define ESP_FLASH_MANIFEST_H
+
+#include <cstdint>
+#include <vector>
+
+#include <QString>
+
+class EspFlashManifest
+{
+public:
+    struct Image {
+        uint32_t offset = 0;
+        QString path;
+        std::vector<uint8_t> data;
+    };
+
+    // one contiguous run of flash made of one or more images
+    struct Extent {
+        uint32_t offset = 0;
+        std::vector<uint8_t> data;
+        int images = 0;
+    };
+
+    std::vector<Image> images;
+
+    bool load(const QString &path);
+    bool addImage(uint32_t offset, const QString &path);
+    void addImage(uint32_t offset, const std::vector<uint8_t> &data, const QString &name = QString());
+
+    bool validate() const;
+    std::vector<Extent> extents(uint32_t sector_size = 0x1000) const;
+    quint64 totalBytes(uint32_t sector_size = 0x1000) const;
+
+private:
+    bool loadFlasherArgs(const QByteArray &content, const QString &base_dir);
+    bool loadList(const QByteArray &content, const QString &base_dir);
+};
+
+#endif // ESP_FLASH_MANIFEST_H
@@ -0,0 +1,131 @@
+/**
+ ******************************************************************************
+ * @file           : src/manifest_upload.cpp
+ * @brief          : Implements flashing a multi-image manifest in one session.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ */
+
+#include "../esptoolqt.h"
+#include "flash_manifest.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include <algorithm>
+
+using std::vector;
+
+// Write all manifest extents first, then verify each extent with a single
+// device MD5. Only extents that fail are checked block by block, and only
+// the failing blocks are written again.
+bool EspToolQt::flashManifest(const EspFlashManifest& manifest, bool compressed) {
+    QElapsedTimer timer;
+    timer.start();
+
+    // check that target is connected
+    if (target == NULL || !io()->isOpen()) {
+        qInfo() << "[Error] Target is not connected";
+        return false;
+    }
+
+    if (!manifest.validate()) return false;
+    const vector<EspFlashManifest::Extent> extents = manifest.extents(target->FLASH_SECTOR_SIZE());
+    quint64 total_length = 0;
+    for (const EspFlashManifest::Extent& extent : extents) total_length += extent.data.size();
+    if (total_length == 0) {
+        qInfo() << "[INFO] Zero Sized Write Operation Skipped";
+        return true;
+    }
+
+    const uint32_t block_size = uploadBlockSize(total_length);
+    flash_skipped_bytes_ = 0;
+    lastBadRanges.clear();
+
+    // write pass, raw or deflate decided per extent
+    quint64 written = 0;
+    vector<bool> extent_compressed;
+    vector<int> extent_level;
+    for (const EspFlashManifest::Extent& extent : extents) {
+        extent_compressed.push_back(planCompression(extent.data, compressed));
+        extent_level.push_back(flash_deflate_level_);
+        for (uint32_t pos = 0; pos < extent.data.size(); pos += block_size) {
+            const uint32_t current_block_size = std::min<uint32_t>(block_size, extent.data.size() - pos);
+            const vector<uint8_t> block(extent.data.begin() + pos, extent.data.begin() + pos + current_block_size);
+
+            bool result = false;
+            for (int attempt = 0; attempt < 3 && !result; attempt++) {
+                if (isCancelled()) {
+                    closePort();
+                    return false;
+                }
+                if (attempt != 0) qInfo() << "Retry data block";
+                result = flashData(extent.offset + pos, block, extent_compressed.back());
+            }
+            if (!result) {
+                qInfo().noquote() << QString("[ERROR] Flash failed at memory range [0x%1-0x%2]")
+                    .arg(QString::number(extent.offset + pos, 16).toUpper())
+                    .arg(QString::number(extent.offset + pos + current_block_size, 16).toUpper());
+                return false;
+            }
+            written += current_block_size;
+            reportProgress(written, total_length);
+        }
+    }
+    const qint64 write_ms = timer.elapsed();
+
+    // combined verify pass
+    quint64 rewritten = 0;
+    for (size_t i = 0; i < extents.size(); i++) {
+        const EspFlashManifest::Extent& extent = extents[i];
+        flash_deflate_level_ = extent_level[i];
+        vector<uint8_t> md5_from_esp;
+        if (!readFlashMd5(extent.offset, extent.data.size(), &md5_from_esp)) return false;
+        vector<uint8_t> copy = extent.data;
+        if (md5_from_esp == calculate_md5_hash(copy)) continue;
+
+        qInfo().noquote() << QString("[WARNING] Extent at 0x%1 failed verification, checking blocks")
+            .arg(QString::number(extent.offset, 16).toUpper());
+        for (uint32_t pos = 0; pos < extent.data.size(); pos += block_size) {
+            const uint32_t current_block_size = std::min<uint32_t>(block_size, extent.data.size() - pos);
+            const vector<uint8_t> block(extent.data.begin() + pos, extent.data.begin() + pos + current_block_size);
+            if (verifyFlashBlockMd5(extent.offset + pos, block)) continue;
+            if (!flashBlockVerified(extent.offset + pos, block, extent_compressed[i])) {
+                qInfo().noquote() << QString("[ERROR] Flash failed at memory range [0x%1-0x%2]")
+                    .arg(QString::number(extent.offset + pos, 16).toUpper())
+                    .arg(QString::number(extent.offset + pos + current_block_size, 16).toUpper());
+                return false;
+            }
+            rewritten += current_block_size;
+        }
+    }
+
+    const qint64 duration = std::max<qint64>(1, timer.elapsed());
+    const double speed = (static_cast<double>(total_length) * 8 / 1000) / (static_cast<double>(duration) / 1000);
+    qInfo().noquote() << QString("[OK] Flashed %1 images (%2 extents, %3 bytes) in %4 ms, effective speed [kbit/s]: %5")
+        .arg(static_cast<qulonglong>(manifest.images.size()))
+        .arg(static_cast<qulonglong>(extents.size()))
+        .arg(total_length)
+        .arg(duration)
+        .arg(speed, 0, 'f', 2);
+    if (flash_skipped_bytes_ != 0) qInfo() << "[OK] Erased sectors skipped [bytes]:" << flash_skipped_bytes_;
+    if (isDiagEnabled()) {
+        qInfo().noquote() << QString("[esp-diag] flashManifest images=%1 extents=%2 logical=%3 block_size=%4 compressed=%5 write_ms=%6 verify_ms=%7 rewritten=%8 skipped_erased=%9")
+            .arg(static_cast<qulonglong>(manifest.images.size()))
+            .arg(static_cast<qulonglong>(extents.size()))
+            .arg(total_length)
+            .arg(block_size)
+            .arg(compressed ? "yes" : "no")
+            .arg(write_ms)
+            .arg(duration - write_ms)
+            .arg(rewritten)
+            .arg(flash_skipped_bytes_);
+    }
+    return true;
+}
@@ -0,0 +1,188 @@
+/**
+ ******************************************************************************
+ * @file           : src/payload_cache.cpp
+ * @brief          : Implements the compressed flash payload cache.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ */
+
+#include "payload_cache.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QSaveFile>
+
+// Cache files hold the MD5 of the payload followed by the payload itself,
+// so a truncated or damaged file is never sent to a board.
+static const int PAYLOAD_HEADER_SIZE = 16;
+
+EspPayloadCache::Payload::Payload(std::vector<uint8_t> bytes)
+    : owned_(std::move(bytes))
+{
+    data_ = owned_.data();
+    size_ = owned_.size();
+}
+
+EspPayloadCache::Payload::Payload(std::unique_ptr<QFile> file, const uchar *mapped, qint64 mapped_size)
+    : file_(std::move(file)), mapped_(mapped)
+{
+    data_ = mapped + PAYLOAD_HEADER_SIZE;
+    size_ = static_cast<size_t>(mapped_size - PAYLOAD_HEADER_SIZE);
+}
+
+EspPayloadCache::Payload::~Payload()
+{
+    if (file_ && mapped_) file_->unmap(const_cast<uchar*>(mapped_));
+}
+
+EspPayloadCache &EspPayloadCache::shared()
+{
+    static EspPayloadCache cache;
+    return cache;
+}
+
+QString EspPayloadCache::key(const std::vector<uint8_t> &data, uint32_t offset, int level, uint32_t write_size)
+{
+    const QByteArray content_md5 = QCryptographicHash::hash(
+        QByteArray::fromRawData(reinterpret_cast<const char*>(data.data()), static_cast<int>(data.size())),
+        QCryptographicHash::Md5);
+    return QStringLiteral("%1_%2_%3_z%4_w%5")
+        .arg(QString::fromLatin1(content_md5.toHex()))
+        .arg(offset, 8, 16, QChar('0'))
+        .arg(static_cast<qulonglong>(data.size()))
+        .arg(level)
+        .arg(write_size);
+}
+
+EspPayloadCache::PayloadPtr EspPayloadCache::find(const QString &key, const QString &disk_dir)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto entry = entries_.find(key);
+        if (entry != entries_.end()) return entry->second;
+    }
+    if (disk_dir.isEmpty()) return nullptr;
+
+    PayloadPtr payload = loadFromDisk(QDir(disk_dir).filePath(key + QStringLiteral(".deflate")));
+    if (payload) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        remember(key, payload);
+    }
+    return payload;
+}
+
+EspPayloadCache::PayloadPtr EspPayloadCache::insert(const QString &key, std::vector<uint8_t> payload, const QString &disk_dir)
+{
+    if (!disk_dir.isEmpty()) {
+        QDir().mkpath(disk_dir);
+        QSaveFile file(QDir(disk_dir).filePath(key + QStringLiteral(".deflate")));
+        if (file.open(QIODevice::WriteOnly)) {
+            const QByteArray bytes = QByteArray::fromRawData(reinterpret_cast<const char*>(payload.data()), static_cast<int>(payload.size()));
+            file.write(QCryptographicHash::hash(bytes, QCryptographicHash::Md5));
+            file.write(bytes);
+            if (!file.commit()) qInfo() << "[WARNING] Can't write payload cache entry" << file.fileName();
+        }
+    }
+
+    PayloadPtr entry = std::make_shared<const Payload>(std::move(payload));
+    std::lock_guard<std::mutex> lock(mutex_);
+    remember(key, entry);
+    return entry;
+}
+
+void EspPayloadCache::setMemoryLimit(quint64 bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    limit_ = bytes;
+}
+
+void EspPayloadCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    order_.clear();
+    bytes_ = 0;
+}
+
+// Caller holds mutex_. Oldest entries go first once the limit is reached;
+// payloads still in use stay alive through their shared pointers.
+void EspPayloadCache::remember(const QString &key, const PayloadPtr &payload)
+{
+    if (entries_.count(key) != 0) return;
+    entries_[key] = payload;
+    order_.push_back(key);
+    bytes_ += payload->size();
+    while (bytes_ > limit_ && order_.size() > 1) {
+        auto oldest = entries_.find(order_.front());
+        bytes_ -= oldest->second->size();
+        entries_.erase(oldest);
+        order_.pop_front();
+    }
+}
+
+EspPayloadCache::PayloadPtr EspPayloadCache::loadFromDisk(const QString &path)
+{
+    std::unique_ptr<QFile> file(new QFile(path));
+    if (!file->open(QIODevice::ReadOnly)) return nullptr;
+    const qint64 size = file->size();
+    if (size < PAYLOAD_HEADER_SIZE) return nullptr;
+
+    const uchar *mapped = file->map(0, size);
+    if (mapped == nullptr) return nullptr;
+    const QByteArray stored_md5 = QByteArray::fromRawData(reinterpret_cast<const char*>(mapped), PAYLOAD_HEADER_SIZE);
+    const QByteArray md5 = QCryptographicHash::hash(
+        QByteArray::fromRawData(reinterpret_cast<const char*>(mapped) + PAYLOAD_HEADER_SIZE, static_cast<int>(size - PAYLOAD_HEADER_SIZE)),
+        QCryptographicHash::Md5);
+    if (md5 != stored_md5) {
+        qInfo() << "[WARNING] Dropping damaged payload cache entry" << path;
+        file->unmap(const_cast<uchar*>(mapped));
+        file->close();
+        file->remove();
+        return nullptr;
+    }
+    return std::make_shared<const Payload>(std::move(file), mapped, size);
+}
+
+#ifdef KT_SELFTEST
+#include "kt_selftest/kt_selftest.h"
+
+KT_TEST(esp_payload_cache_key_covers_inputs,
+        "key changes with offset, deflate level and write size, not just content") {
+    const std::vector<uint8_t> data(4096, 0x5A);
+    const QString base = EspPayloadCache::key(data, 0x10000, 9, 0x4000);
+    KT_ASSERT(base == EspPayloadCache::key(data, 0x10000, 9, 0x4000));
+    KT_ASSERT(base != EspPayloadCache::key(data, 0x11000, 9, 0x4000));
+    KT_ASSERT(base != EspPayloadCache::key(data, 0x10000, 6, 0x4000));
+    KT_ASSERT(base != EspPayloadCache::key(data, 0x10000, 9, 0x400));
+    KT_ASSERT(base != EspPayloadCache::key(std::vector<uint8_t>(4096, 0xA5), 0x10000, 9, 0x4000));
+}
+
+KT_TEST(esp_payload_cache_evicts_oldest,
+        "memory cache drops the oldest entries to stay within its limit") {
+    EspPayloadCache cache;
+    cache.setMemoryLimit(100);
+    cache.insert("a", std::vector<uint8_t>(60, 1));
+    cache.insert("b", std::vector<uint8_t>(30, 2));
+    KT_ASSERT(cache.find("a") != nullptr);
+
+    cache.insert("c", std::vector<uint8_t>(40, 3));
+    KT_ASSERT(cache.find("a") == nullptr);
+    KT_ASSERT(cache.find("b") != nullptr);
+    KT_ASSERT(cache.find("c") != nullptr);
+
+    // a payload held by the caller outlives its eviction
+    EspPayloadCache::PayloadPtr held = cache.find("b");
+    cache.insert("d", std::vector<uint8_t>(70, 4));
+    KT_ASSERT(cache.find("b") == nullptr);
+    KT_ASSERT_EQ(held->size(), static_cast<size_t>(30));
+    KT_ASSERT_EQ(held->data()[0], static_cast<uint8_t>(2));
+}
+
+#endif // KT_SELFTEST
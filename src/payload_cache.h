@@ -0,0 +1,91 @@
+/**
+ ******************************************************************************
+ * @file           : src/payload_cache.h
+ * @brief          : Declares the compressed flash payload cache.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ * @details
+ *
+ * Flashing one firmware to many boards compresses the same blocks over and
+ * over. This cache keeps deflated flash payloads keyed by block content,
+ * flash offset, block size, compression level and FLASH_WRITE_SIZE, so each
+ * block is compressed once per host.
+ *
+ * Entries live in a bounded in-process memory cache shared by all EspToolQt
+ * instances. With a cache directory set they are also written to disk and
+ * memory mapped on lookup, so other flasher processes on the same host reuse
+ * them straight from the page cache.
+ *
+ * Usage Example:
+ * ```cpp
+ * const QString key = EspPayloadCache::key(block, offset, 9, write_size);
+ * EspPayloadCache::PayloadPtr payload = EspPayloadCache::shared().find(key, dir);
+ * if (!payload) payload = EspPayloadCache::shared().insert(key, compress_vector(block), dir);
+ * ```
+ *
+ ******************************************************************************
+ */
+
+#ifndef ESP_PAYLOAD_CACHE_H
+#define ESP_PAYLOAD_CACHE_H
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <QFile>
+#include <QString>
+
+class EspPayloadCache
+{
+public:
+    // compressed bytes, owned or mapped from a cache file
+    class Payload {
+    public:
+        explicit Payload(std::vector<uint8_t> bytes);
+        Payload(std::unique_ptr<QFile> file, const uchar *mapped, qint64 mapped_size);
+        ~Payload();
+        Payload(const Payload &) = delete;
+        Payload &operator=(const Payload &) = delete;
+
+        const uint8_t *data() const { return data_; }
+        size_t size() const { return size_; }
+
+    private:
+        std::vector<uint8_t> owned_;
+        std::unique_ptr<QFile> file_;
+        const uchar *mapped_ = nullptr;
+        const uint8_t *data_ = nullptr;
+        size_t size_ = 0;
+    };
+    using PayloadPtr = std::shared_ptr<const Payload>;
+
+    static EspPayloadCache &shared();
+    static QString key(const std::vector<uint8_t> &data, uint32_t offset, int level, uint32_t write_size);
+
+    PayloadPtr find(const QString &key, const QString &disk_dir = QString());
+    PayloadPtr insert(const QString &key, std::vector<uint8_t> payload, const QString &disk_dir = QString());
+    void setMemoryLimit(quint64 bytes);
+    void clear();
+
+private:
+    void remember(const QString &key, const PayloadPtr &payload);
+    PayloadPtr loadFromDisk(const QString &path);
+
+    std::mutex mutex_;
+    std::map<QString, PayloadPtr> entries_;
+    std::deque<QString> order_;
+    quint64 bytes_ = 0;
+    quint64 limit_ = 64 * 1024 * 1024;
+};
+
+#endif // ESP_PAYLOAD_CACHE_H
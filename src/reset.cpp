@@ -70,6 +70,8 @@ private:
 
 void EspToolQt::resetToBoot(ResetStrategy strategy)
 {
+    EspTrace::Span span = traceSpan("reset", "connect");
+    span.arg("strategy", static_cast<int>(strategy));
     EspLineControl lines(serial, swapDtrRts);
 
     switch (strategy)
@@ -110,6 +112,7 @@ void EspToolQt::resetToBoot(ResetStrategy strategy)
 
 void EspToolQt::resetFromBoot()
 {
+    EspTrace::Span span = traceSpan("hard_reset", "session");
     // Reset sequence for hard resetting the chip.
     // Can be used to reset out of the bootloader or to restart a running app.
     // https://github.com/espressif/esptool/blob/master/esptool/reset.py
@@ -0,0 +1,226 @@
+/**
+ ******************************************************************************
+ * @file           : src/resume.cpp
+ * @brief          : Implements resumable flash dumps and uploads.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ */
+
+#include "../esptoolqt.h"
+#include "flash_journal.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+
+#include <algorithm>
+
+using std::vector;
+
+namespace {
+
+const uint32_t RESUME_CHUNK_SIZE = 256 * 1024;
+
+QString journalPath(const QString &path)
+{
+    return path + QStringLiteral(".journal");
+}
+
+QByteArray md5Of(const QByteArray &data)
+{
+    return QCryptographicHash::hash(data, QCryptographicHash::Md5);
+}
+
+} // namespace
+
+// Journals and caches are only trusted for the exact device they were written
+// against: base MAC plus SPI flash JEDEC ID. Families without a MAC reader
+// cannot resume or use the sector cache.
+bool EspToolQt::flashDeviceIdentity(QString* mac, uint32_t* flash_id) {
+    vector<uint8_t> mac_bytes;
+    getChipBaseMac(&mac_bytes);
+    *mac = mac_bytes.size() == 6 ? EspFlashJournal::macToString(mac_bytes) : QString();
+    *flash_id = getFlashId();
+    if (mac->isEmpty()) {
+        qInfo() << "[WARNING] Chip MAC is not available, resume journal and sector cache disabled";
+        return false;
+    }
+    return true;
+}
+
+// Dump flash into a file chunk by chunk. Every chunk is MD5 checked by the
+// stub, written to its place in the file and recorded in <path>.journal. When
+// the dump is interrupted (cancel, USB drop) a later call for the same device
+// and range continues from the first chunk that is not in the journal.
+bool EspToolQt::readFlashToFile(uint32_t offset, uint32_t size, const QString& path) {
+    // check that target is connected
+    if (target == NULL || !io()->isOpen()) {
+        qInfo() << "[Error] Target is not connected";
+        return false;
+    }
+
+    EspFlashJournal job;
+    job.kind = QStringLiteral("read");
+    job.offset = offset;
+    job.size = size;
+    job.chunk_size = RESUME_CHUNK_SIZE;
+    const bool can_resume = flashDeviceIdentity(&job.mac, &job.flash_id);
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadWrite)) {
+        qInfo() << "[ERROR] Can't open dump file" << path << file.errorString();
+        return false;
+    }
+
+    // keep only journal chunks that are still intact in the file
+    EspFlashJournal previous;
+    if (can_resume && previous.load(journalPath(path)) && job.sameJob(previous)
+        && file.size() == static_cast<qint64>(size)) {
+        for (const EspFlashJournal::Range &range : previous.ranges) {
+            file.seek(range.offset);
+            if (md5Of(file.read(range.size)) == range.md5) {
+                job.ranges.push_back(range);
+            }
+        }
+        qInfo() << "[OK] Resuming flash dump," << job.completedBytes() << "bytes already done";
+    } else {
+        file.resize(0);
+        file.resize(size);
+    }
+
+    quint64 done = job.completedBytes();
+    for (uint32_t chunk = 0; chunk < size; chunk += RESUME_CHUNK_SIZE) {
+        const uint32_t chunk_size = std::min(RESUME_CHUNK_SIZE, size - chunk);
+        if (job.hasRange(chunk, chunk_size)) continue;
+        if (isCancelled()) {
+            closePort();
+            return false;
+        }
+
+        read_progress_base_ = done;
+        read_progress_total_ = size;
+        vector<uint8_t> data = readFlashFast(offset + chunk, chunk_size);
+        read_progress_base_ = 0;
+        read_progress_total_ = 0;
+        if (data.size() != chunk_size) {
+            qInfo().noquote() << QString("[ERROR] Flash dump stopped at 0x%1, %2 of %3 bytes kept for resume")
+                .arg(QString::number(offset + chunk, 16).toUpper())
+                .arg(done)
+                .arg(size);
+            return false;
+        }
+
+        const QByteArray bytes(reinterpret_cast<const char*>(data.data()), static_cast<int>(data.size()));
+        file.seek(chunk);
+        if (file.write(bytes) != bytes.size() || !file.flush()) {
+            qInfo() << "[ERROR] Can't write dump file" << path << file.errorString();
+            return false;
+        }
+        job.addRange(chunk, chunk_size, md5Of(bytes));
+        if (can_resume) job.save(journalPath(path));
+        done += chunk_size;
+    }
+
+    file.close();
+    QFile::remove(journalPath(path));
+    readProgress(size, size);
+    qInfo() << "[OK] Flash dump saved to" << path;
+    return true;
+}
+
+// Upload with the same block layout as flashUpload(), recording every block
+// that passed its MD5 check in a journal. On a later call with the same image
+// and device, the journal is trusted after a device-side MD5 spot check of
+// the first and last recorded blocks, and the upload skips straight to the
+// first block that is not recorded.
+bool EspToolQt::flashUploadJournaled(uint32_t memory_offset, std::vector<uint8_t> data, const QString& journal_path, bool compressed) {
+    // check that target is connected
+    if (target == NULL || !io()->isOpen()) {
+        qInfo() << "[Error] Target is not connected";
+        return false;
+    }
+
+    // skip zero size writes
+    if (data.size() == 0) {
+        qInfo() << "[INFO] Zero Sized Write Operation Skipped";
+        return true;
+    }
+
+    // make data length multiple of 4
+    uint32_t padding_required = (4 - data.size() % 4) % 4;
+    if (padding_required) data.resize(data.size() + padding_required, 0xFF);
+
+    const uint32_t total_length = data.size();
+    const uint32_t block_size = uploadBlockSize(total_length);
+    flash_skipped_bytes_ = 0;
+    lastBadRanges.clear();
+    compressed = planCompression(data, compressed);
+
+    EspFlashJournal job;
+    job.kind = QStringLiteral("write");
+    job.offset = memory_offset;
+    job.size = total_length;
+    job.chunk_size = block_size;
+    job.image_md5 = md5Of(QByteArray(reinterpret_cast<const char*>(data.data()), static_cast<int>(data.size())));
+    const bool can_resume = flashDeviceIdentity(&job.mac, &job.flash_id);
+
+    auto block_of = [&](uint32_t block_offset, uint32_t size) {
+        return vector<uint8_t>(data.begin() + block_offset, data.begin() + block_offset + size);
+    };
+
+    EspFlashJournal previous;
+    if (can_resume && previous.load(journal_path) && job.sameJob(previous) && !previous.ranges.empty()) {
+        // spot check: the blocks at both ends of the journal must still be on flash
+        const EspFlashJournal::Range& first = previous.ranges.front();
+        const EspFlashJournal::Range& last = previous.ranges.back();
+        const bool first_ok = verifyFlashBlockMd5(memory_offset + first.offset, block_of(first.offset, first.size));
+        const bool last_ok = first_ok && verifyFlashBlockMd5(memory_offset + last.offset, block_of(last.offset, last.size));
+        if (isCancelled()) {
+            closePort();
+            return false;
+        }
+        if (first_ok && last_ok) {
+            job.ranges = previous.ranges;
+            qInfo() << "[OK] Resuming flash upload," << job.completedBytes() << "bytes already verified";
+        } else {
+            qInfo() << "[WARNING] Flash content does not match upload journal, starting over";
+        }
+    }
+
+    for (uint32_t block_offset = 0; block_offset < total_length; block_offset += block_size) {
+        if (isCancelled()) {
+            closePort();
+            return false;
+        }
+        const uint32_t current_block_size = std::min(block_size, total_length - block_offset);
+        if (!job.hasRange(block_offset, current_block_size)) {
+            vector<uint8_t> block = block_of(block_offset, current_block_size);
+            if (!flashBlockVerified(memory_offset + block_offset, block, compressed)) {
+                if (isCancelled()) return false;
+                qInfo().noquote() << QString("[ERROR] Flash failed at memory range [0x%1-0x%2]")
+                    .arg(QString::number(memory_offset + block_offset, 16).toUpper())
+                    .arg(QString::number(memory_offset + block_offset + current_block_size, 16).toUpper());
+                return false;
+            }
+            job.addRange(block_offset, current_block_size,
+                         md5Of(QByteArray(reinterpret_cast<const char*>(block.data()), static_cast<int>(block.size()))));
+            if (can_resume) job.save(journal_path);
+        }
+
+        // update progress bar
+        quint64 written = block_offset + current_block_size;
+        reportProgress(written, static_cast<quint64>(total_length));
+    }
+
+    QFile::remove(journal_path);
+    if (flash_skipped_bytes_ != 0) qInfo() << "[OK] Erased sectors skipped [bytes]:" << flash_skipped_bytes_;
+    qInfo() << "[OK] Journaled flash upload done";
+    return true;
+}
@@ -0,0 +1,114 @@
+/**
+ ******************************************************************************
+ * @file           : src/rto.cpp
+ * @brief          : Implements the per-command retransmission timeout estimator.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ */
+
+#include "rto.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// timer granularity, the variation term never drops below it
+const double kGranularityMs = 10;
+const int kMaxBackoff = 16;
+// Small jobs are dominated by fixed overhead; counting them as at least this
+// much work keeps their per-unit time on the high, safe side.
+const double kMinWork = 1.0 / 64;
+
+}
+
+// 10 bits per byte on an 8N1 line
+double EspRtoEstimator::wireMs(uint64_t wire_bytes, uint32_t baud)
+{
+    if (baud == 0) return 0;
+    return static_cast<double>(wire_bytes) * 10 * 1000 / baud;
+}
+
+int EspRtoEstimator::rto(int command_class) const
+{
+    auto found = classes_.find(command_class);
+    if (found == classes_.end() || found->second.samples == 0) return 0;
+    const Stats &stats = found->second;
+    return static_cast<int>(std::ceil(stats.srtt_ms + std::max(kGranularityMs, 4 * stats.rttvar_ms)));
+}
+
+int EspRtoEstimator::timeout(int command_class, int fallback_ms, uint64_t wire_bytes, uint32_t baud, double work) const
+{
+    auto found = classes_.find(command_class);
+    if (found == classes_.end() || found->second.samples == 0) {
+        // still unknown, but a timeout already seen still backs off
+        const int backoff = found == classes_.end() ? 1 : found->second.backoff;
+        return std::min(max_timeout_ms, fallback_ms * backoff);
+    }
+    const double unit = rto(command_class);
+    const double timeout_ms = (wireMs(wire_bytes, baud) + unit * std::max(kMinWork, work)) * found->second.backoff;
+    // a learned value may undercut the fixed one, but not USB latency
+    const int floor_ms = std::min(fallback_ms, min_timeout_ms);
+    return std::max(floor_ms, std::min(max_timeout_ms, static_cast<int>(std::ceil(timeout_ms))));
+}
+
+void EspRtoEstimator::sample(int command_class, double elapsed_ms, uint64_t wire_bytes, uint32_t baud, double work)
+{
+    const double rtt = std::max(0.0, elapsed_ms - wireMs(wire_bytes, baud)) / std::max(kMinWork, work);
+    Stats &stats = classes_[command_class];
+    if (stats.samples == 0) {
+        stats.srtt_ms = rtt;
+        stats.rttvar_ms = rtt / 2;
+    } else {
+        stats.rttvar_ms = 0.75 * stats.rttvar_ms + 0.25 * std::fabs(stats.srtt_ms - rtt);
+        stats.srtt_ms = 0.875 * stats.srtt_ms + 0.125 * rtt;
+    }
+    stats.samples++;
+    stats.backoff = 1;
+}
+
+void EspRtoEstimator::timedOut(int command_class)
+{
+    Stats &stats = classes_[command_class];
+    stats.timeouts++;
+    stats.backoff = std::min(kMaxBackoff, stats.backoff * 2);
+}
+
+#ifdef KT_SELFTEST
+#include "kt_selftest/kt_selftest.h"
+
+KT_TEST(esp_rto_learns_and_backs_off,
+        "fallback until sampled, wire time scales with baud, timeouts double") {
+    EspRtoEstimator rto;
+    rto.min_timeout_ms = 50;
+    KT_ASSERT_EQ(rto.timeout(0x03, 5000, 16384, 115200), 5000);
+
+    for (int i = 0; i < 8; i++) rto.sample(0x03, 20 + EspRtoEstimator::wireMs(16384, 115200), 16384, 115200);
+    const int fast = rto.timeout(0x03, 5000, 16384, 2000000);
+    const int slow = rto.timeout(0x03, 5000, 16384, 115200);
+    KT_ASSERT(fast < 200);
+    KT_ASSERT(slow > 1422 && slow < 1700);
+
+    rto.timedOut(0x03);
+    KT_ASSERT_EQ(rto.timeout(0x03, 5000, 16384, 2000000), 2 * fast);
+    rto.sample(0x03, 20, 0, 2000000);
+    KT_ASSERT(rto.timeout(0x03, 5000, 16384, 2000000) < 200);
+}
+
+KT_TEST(esp_rto_floor,
+        "learned timeouts undercut the fixed one but stay above the USB floor") {
+    EspRtoEstimator rto;
+    for (int i = 0; i < 8; i++) rto.sample(0x0A, 0, 0, 921600);
+    KT_ASSERT_EQ(rto.timeout(0x0A, 1000, 20, 921600), rto.min_timeout_ms);
+    KT_ASSERT_EQ(rto.timeout(0x0A, 100, 20, 921600), 100);
+    for (int i = 0; i < 8; i++) rto.sample(0x0B, 400, 0, 921600);
+    KT_ASSERT(rto.timeout(0x0B, 1000, 20, 921600) > 400);
+}
+
+#endif // KT_SELFTEST
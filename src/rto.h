@@ -0,0 +1,70 @@
+/**
+ ******************************************************************************
+ * @file           : src/rto.h
+ * @brief          : Declares the per-command retransmission timeout estimator.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ * @details
+ *
+ * Learns how long the target takes to answer each command class and turns
+ * that into reply timeouts, in the spirit of TCP's RTO (RFC 6298): a
+ * smoothed round trip time plus four times its variation. Samples are
+ * normalised before they are learned: the time the request and reply spend
+ * on the wire at the current baud is taken out, and what is left is divided
+ * by the work the command does (MB hashed or erased, 1 for the rest), so a
+ * value learned at 115200 baud on small blocks still fits 2 Mbaud on large
+ * ones. A timeout doubles the next one until a reply comes back. Classes
+ * without samples keep the caller's fixed timeout.
+ *
+ * Usage Example:
+ * ```cpp
+ * const int timeout_ms = rto.timeout(ESP_FLASH_DATA, 5000, packet.size() + 12, baud);
+ * ...
+ * if (reply.empty()) rto.timedOut(ESP_FLASH_DATA);
+ * else rto.sample(ESP_FLASH_DATA, elapsed_ms, packet.size() + 12, baud);
+ * ```
+ *
+ ******************************************************************************
+ */
+
+#ifndef ESP_RTO_H
+#define ESP_RTO_H
+
+#include <cstdint>
+#include <map>
+
+class EspRtoEstimator
+{
+public:
+    struct Stats {
+        uint32_t samples = 0;
+        uint32_t timeouts = 0;
+        double srtt_ms = 0;         // smoothed, per unit of work, wire time removed
+        double rttvar_ms = 0;
+        int backoff = 1;
+    };
+
+    static double wireMs(uint64_t wire_bytes, uint32_t baud);
+
+    int timeout(int command_class, int fallback_ms, uint64_t wire_bytes, uint32_t baud, double work = 1) const;
+    void sample(int command_class, double elapsed_ms, uint64_t wire_bytes, uint32_t baud, double work = 1);
+    void timedOut(int command_class);
+    void reset() { classes_.clear(); }
+
+    const std::map<int, Stats> &stats() const { return classes_; }
+    int rto(int command_class) const;   // learned value for one unit of work, 0 if unknown
+
+    int min_timeout_ms = 250;           // USB serial latency and jitter, capped at the fixed timeout
+    int max_timeout_ms = 120000;
+
+private:
+    std::map<int, Stats> classes_;
+};
+
+#endif // ESP_RTO_H
@@ -0,0 +1,150 @@
+/**
+ ******************************************************************************
+ * @file           : src/sector_cache.cpp
+ * @brief          : Implements the host-side flash sector cache.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ */
+
+#include "sector_cache.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+EspSectorCache::EspSectorCache(const QString &root, const QString &device_key)
+    : dir_(QDir(root).filePath(device_key))
+{
+    QDir().mkpath(QDir(dir_).filePath(QStringLiteral("sectors")));
+}
+
+QString EspSectorCache::deviceKey(const QString &mac, uint32_t flash_id)
+{
+    QString key = mac;
+    key.remove(QStringLiteral(":"));
+    return QStringLiteral("%1_%2").arg(key).arg(flash_id, 6, 16, QChar('0'));
+}
+
+QString EspSectorCache::sectorPath(const QByteArray &md5) const
+{
+    return QDir(dir_).filePath(QStringLiteral("sectors/") + QString::fromLatin1(md5.toHex()));
+}
+
+bool EspSectorCache::lookup(const QByteArray &md5, std::vector<uint8_t> *data) const
+{
+    QFile file(sectorPath(md5));
+    if (!file.open(QIODevice::ReadOnly)) return false;
+    const QByteArray content = file.readAll();
+
+    // never trust a damaged cache entry
+    if (QCryptographicHash::hash(content, QCryptographicHash::Md5) != md5) {
+        file.close();
+        file.remove();
+        return false;
+    }
+    data->assign(reinterpret_cast<const uint8_t*>(content.constData()),
+                 reinterpret_cast<const uint8_t*>(content.constData()) + content.size());
+    return true;
+}
+
+QByteArray EspSectorCache::store(const uint8_t *data, uint32_t size)
+{
+    const QByteArray content(reinterpret_cast<const char*>(data), static_cast<int>(size));
+    const QByteArray md5 = QCryptographicHash::hash(content, QCryptographicHash::Md5);
+    const QString path = sectorPath(md5);
+    if (QFile::exists(path)) return md5;
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qInfo() << "[WARNING] Can't write sector cache entry" << path;
+        return md5;
+    }
+    file.write(content);
+    file.commit();
+    return md5;
+}
+
+bool EspSectorCache::loadMap()
+{
+    map_.clear();
+    QFile file(QDir(dir_).filePath(QStringLiteral("map.json")));
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    const QJsonDocument document = QJsonDocument::fromJson(file.readAll());
+    if (!document.isObject()) return false;
+    const QJsonObject root = document.object();
+    for (auto it = root.constBegin(); it != root.constEnd(); ++it) {
+        bool ok = false;
+        const uint32_t offset = it.key().toUInt(&ok, 16);
+        if (ok) map_[offset] = QByteArray::fromHex(it.value().toString().toLatin1());
+    }
+    return true;
+}
+
+bool EspSectorCache::saveMap() const
+{
+    QJsonObject root;
+    for (const auto &entry : map_) {
+        root.insert(QString::number(entry.first, 16), QString::fromLatin1(entry.second.toHex()));
+    }
+    QSaveFile file(QDir(dir_).filePath(QStringLiteral("map.json")));
+    if (!file.open(QIODevice::WriteOnly)) return false;
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
+
+QByteArray EspSectorCache::mapped(uint32_t offset) const
+{
+    auto entry = map_.find(offset);
+    return entry == map_.end() ? QByteArray() : entry->second;
+}
+
+void EspSectorCache::setMapped(uint32_t offset, const QByteArray &md5)
+{
+    map_[offset] = md5;
+}
+
+#ifdef KT_SELFTEST
+#include "kt_selftest/kt_selftest.h"
+
+#include <QTemporaryDir>
+
+KT_TEST(esp_sector_cache_round_trip,
+        "stored sectors come back by MD5, the offset map survives a reload") {
+    QTemporaryDir root;
+    KT_ASSERT(root.isValid());
+    const QString device = EspSectorCache::deviceKey(QStringLiteral("24:0A:C4:00:11:22"), 0x1640EF);
+    KT_ASSERT(device == QStringLiteral("240AC4001122_1640ef"));
+
+    EspSectorCache cache(root.path(), device);
+    const std::vector<uint8_t> sector(0x1000, 0x5A);
+    const QByteArray md5 = cache.store(sector.data(), static_cast<uint32_t>(sector.size()));
+    KT_ASSERT_EQ(md5.size(), 16);
+
+    std::vector<uint8_t> loaded;
+    KT_ASSERT(cache.lookup(md5, &loaded));
+    KT_ASSERT(loaded == sector);
+    KT_ASSERT(!cache.lookup(QByteArray(16, '\0'), &loaded));
+
+    cache.setMapped(0x9000, md5);
+    KT_ASSERT(cache.mapped(0x9000) == md5);
+    KT_ASSERT(cache.mapped(0xA000).isEmpty());
+    KT_ASSERT(cache.saveMap());
+
+    EspSectorCache reloaded(root.path(), device);
+    KT_ASSERT(reloaded.loadMap());
+    KT_ASSERT(reloaded.mapped(0x9000) == md5);
+    KT_ASSERT(reloaded.lookup(md5, &loaded));
+}
+
+#endif // KT_SELFTEST
@@ -0,0 +1,66 @@
+/**
+ ******************************************************************************
+ * @file           : src/sector_cache.h
+ * @brief          : Declares the host-side flash sector cache.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ * @details
+ *
+ * Keeps flash sector contents on disk, addressed by their MD5, in one
+ * directory per device (base MAC + SPI flash JEDEC ID). Next to the content
+ * store, a map remembers which MD5 was seen at which flash offset during the
+ * last read, so a repeat dump can check whole regions with a single device
+ * MD5 request before falling back to per-sector hashes.
+ *
+ * Layout:
+ * - <root>/<device>/sectors/<md5 hex>   sector contents
+ * - <root>/<device>/map.json            offset -> md5 of the last read
+ *
+ * Usage Example:
+ * ```cpp
+ * EspSectorCache cache(root, EspSectorCache::deviceKey(mac, flash_id));
+ * cache.loadMap();
+ * ```
+ *
+ ******************************************************************************
+ */
+
+#ifndef ESP_SECTOR_CACHE_H
+#define ESP_SECTOR_CACHE_H
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include <QByteArray>
+#include <QString>
+
+class EspSectorCache
+{
+public:
+    EspSectorCache(const QString &root, const QString &device_key);
+
+    static QString deviceKey(const QString &mac, uint32_t flash_id);
+
+    bool lookup(const QByteArray &md5, std::vector<uint8_t> *data) const;
+    QByteArray store(const uint8_t *data, uint32_t size);
+
+    bool loadMap();
+    bool saveMap() const;
+    QByteArray mapped(uint32_t offset) const;
+    void setMapped(uint32_t offset, const QByteArray &md5);
+
+private:
+    QString sectorPath(const QByteArray &md5) const;
+
+    QString dir_;
+    std::map<uint32_t, QByteArray> map_;
+};
+
+#endif // ESP_SECTOR_CACHE_H
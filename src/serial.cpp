@@ -15,6 +15,8 @@
 #include "../esptoolqt.h"
 #include "../read_agent/esp_read_agent.h"
 #include "defines.h"
+#include "compress.h"
+#include "payload_cache.h"
 #include <cmath>
 
 #include <QThread>
@@ -27,7 +29,10 @@
 #include <zlib.h>
 #include <QFile>
 
+#include <algorithm>
 #include <atomic>
+#include <functional>
+#include <future>
 
 #if defined(Q_OS_WIN32)
 #  include <qt_windows.h>
@@ -342,6 +347,7 @@ void EspToolQt::setPortName(QString name) {
 bool EspToolQt::openPort() {
     if (serial == NULL) return false;
     if (isCancelled()) return false;
+    if (transport_ != NULL && transport_->isOpen()) return true;
     const bool diag = isDiagEnabled();
     if (diag) qInfo() << "[esp-diag] openPort before clearError" << serialDiagState(serial)
                       << "available" << availablePortsDiagString();
@@ -399,23 +405,88 @@ void EspToolQt::closePort() {
 }
 
 bool EspToolQt::hasSerialError() const {
-    if (serial == NULL) return true;
-    switch (serial->error()) {
-    case QSerialPort::NoError:
-    case QSerialPort::TimeoutError:
-        return false;
-    default:
-        return true;
-    }
+    return io()->hasError();
 }
 
 bool EspToolQt::isSerialUsable() const {
-    return serial != NULL && serial->isOpen() && !hasSerialError();
+    return io()->isOpen() && !io()->hasError();
 }
 
 QString EspToolQt::serialErrorString() const {
-    if (serial == NULL) return QStringLiteral("Serial port is not initialized");
-    return serial->errorString();
+    return io()->errorString();
+}
+
+EspTransport* EspToolQt::io() const {
+    if (capture_) return capture_.get();
+    if (transport_ != NULL) return transport_;
+    return serial_transport_.get();
+}
+
+// Route all traffic through another transport, e.g. an EspReplayTransport.
+// The transport is not owned; nullptr goes back to the serial port.
+void EspToolQt::setTransport(EspTransport* transport) {
+    stopCapture();
+    transport_ = transport;
+    serial_frame_buffer_.clear();
+}
+
+// Record every chunk sent and received from now on to a capture file that
+// EspReplayTransport can play back.
+bool EspToolQt::startCapture(const QString& path) {
+    stopCapture();
+    std::unique_ptr<EspCaptureTransport> capture(new EspCaptureTransport(io()));
+    if (!capture->open(path)) return false;
+    capture_ = std::move(capture);
+    qInfo() << "[OK] Capturing serial traffic to" << path;
+    return true;
+}
+
+// Record spans of this session into trace on a track of its own. The trace
+// is not owned and may be shared with other sessions; nullptr stops tracing.
+void EspToolQt::setTrace(EspTrace* trace, const QString& track_name) {
+    trace_ = trace;
+    if (trace_ != NULL) trace_track_ = trace_->addTrack(track_name.isEmpty() ? esp_target_info.com_port : track_name);
+}
+
+EspTrace::Span EspToolQt::traceSpan(const char* name, const char* category) const {
+    if (trace_ == NULL) return EspTrace::Span();
+    return EspTrace::Span(trace_, trace_track_, name, category);
+}
+
+// Reply timeout for one exchange: learned per command class once replies
+// have been timed, the caller's fixed value before that.
+int EspToolQt::replyTimeout(int command_class, int fallback_ms, quint64 wire_bytes, double work) const {
+    if (!adaptive_timeouts) return fallback_ms;
+    return rto_.timeout(command_class, fallback_ms, wire_bytes, static_cast<uint32_t>(serial->baudRate()), work);
+}
+
+void EspToolQt::replySample(int command_class, qint64 elapsed_ms, quint64 wire_bytes, bool replied, double work) {
+    if (isCancelled()) return;
+    if (replied) {
+        rto_.sample(command_class, static_cast<double>(elapsed_ms), wire_bytes, static_cast<uint32_t>(serial->baudRate()), work);
+    } else {
+        rto_.timedOut(command_class);
+    }
+}
+
+void EspToolQt::logRtoDiag() const {
+    for (const auto& entry : rto_.stats()) {
+        qInfo().noquote() << QString("[esp-diag] rto class=0x%1 samples=%2 timeouts=%3 srtt_ms=%4 rttvar_ms=%5 rto_ms=%6 backoff=%7")
+            .arg(QString::number(entry.first, 16).toUpper())
+            .arg(entry.second.samples)
+            .arg(entry.second.timeouts)
+            .arg(entry.second.srtt_ms, 0, 'f', 2)
+            .arg(entry.second.rttvar_ms, 0, 'f', 2)
+            .arg(rto_.rto(entry.first))
+            .arg(entry.second.backoff);
+    }
+}
+
+void EspToolQt::stopCapture() {
+    if (!capture_) return;
+    capture_->finish();
+    qInfo() << "[OK] Capture finished, records:" << capture_->records();
+    capture_.reset();
 }
 
 bool EspToolQt::serialWrite(vector<uint8_t> data, int timeout_ms) {
@@ -425,16 +496,16 @@ bool EspToolQt::serialWrite(vector<uint8_t> data, int timeout_ms) {
         closePort();
         return false;
     }
-    serial->clear();
-    const qint64 written = serial->write(reinterpret_cast<const char*>(data.data()), data.size());
+    io()->clear();
+    const qint64 written = io()->write(reinterpret_cast<const char*>(data.data()), data.size());
     if (written < 0) {
         qInfo() << "[ERROR] Serial write failed:" << serialErrorString();
         closePort();
         return false;
     }
-    if (!serial->waitForBytesWritten(timeout_ms)) {
+    if (!io()->waitForBytesWritten(timeout_ms)) {
         if (isCancelled()) return false;
-        if (!serial->isOpen() || hasSerialError()) {
+        if (!io()->isOpen() || hasSerialError()) {
             qInfo() << "[ERROR] Serial write wait failed:" << serialErrorString();
             closePort();
         }
@@ -450,15 +521,15 @@ bool EspToolQt::serialWriteWithoutInputClear(vector<uint8_t> data, int timeout_m
         closePort();
         return false;
     }
-    const qint64 written = serial->write(reinterpret_cast<const char*>(data.data()), data.size());
+    const qint64 written = io()->write(reinterpret_cast<const char*>(data.data()), data.size());
     if (written < 0) {
         qInfo() << "[ERROR] Serial write failed:" << serialErrorString();
         closePort();
         return false;
     }
-    if (!serial->waitForBytesWritten(timeout_ms)) {
+    if (!io()->waitForBytesWritten(timeout_ms)) {
         if (isCancelled()) return false;
-        if (!serial->isOpen() || hasSerialError()) {
+        if (!io()->isOpen() || hasSerialError()) {
             qInfo() << "[ERROR] Serial write wait failed:" << serialErrorString();
             closePort();
         }
@@ -467,6 +538,25 @@ bool EspToolQt::serialWriteWithoutInputClear(vector<uint8_t> data, int timeout_m
     return true;
 }
 
+// Queue data without waiting for it to drain. Pending bytes are pushed out by
+// the next waitForReadyRead()/waitForBytesWritten() on the port, which the
+// frame readers call anyway.
+bool EspToolQt::serialWriteNoWait(const vector<uint8_t>& data) {
+    if (isCancelled()) return false;
+    if (!isSerialUsable()) {
+        qInfo() << "[ERROR] Serial port is not usable before write:" << serialErrorString();
+        closePort();
+        return false;
+    }
+    const qint64 written = io()->write(reinterpret_cast<const char*>(data.data()), data.size());
+    if (written < 0) {
+        qInfo() << "[ERROR] Serial write failed:" << serialErrorString();
+        closePort();
+        return false;
+    }
+    return true;
+}
+
 vector<uint8_t> EspToolQt::serialRead(int timeout_ms) {
     QTime timeout = QTime::currentTime().addMSecs(timeout_ms);
     vector<uint8_t> data;
@@ -480,13 +570,13 @@ vector<uint8_t> EspToolQt::serialRead(int timeout_ms) {
     while(QTime::currentTime().msecsTo(timeout) > 0)
     {
         if (isCancelled()) return data;
-        if (!serial->waitForReadyRead(5) && (!serial->isOpen() || hasSerialError())) {
+        if (!io()->waitForReadyRead(5) && (!io()->isOpen() || hasSerialError())) {
             qInfo() << "[ERROR] Serial read wait failed:" << serialErrorString();
             closePort();
             return data;
         }
-        QByteArray byte_array = serial->readAll();
-        if (!serial->isOpen() || hasSerialError()) {
+        QByteArray byte_array = io()->readAll();
+        if (!io()->isOpen() || hasSerialError()) {
             qInfo() << "[ERROR] Serial read failed:" << serialErrorString();
             closePort();
             return data;
@@ -498,6 +588,19 @@ vector<uint8_t> EspToolQt::serialRead(int timeout_ms) {
     return data;
 }
 
+// Throw away input until nothing arrived for idle_ms, or max_ms passed.
+void EspToolQt::serialDrain(int idle_ms, int max_ms) {
+    QElapsedTimer total;
+    total.start();
+    QElapsedTimer idle;
+    idle.start();
+    while (idle.elapsed() < idle_ms && total.elapsed() < max_ms) {
+        if (isCancelled() || !isSerialUsable()) return;
+        io()->waitForReadyRead(5);
+        if (!io()->readAll().isEmpty()) idle.restart();
+    }
+}
+
 vector<uint8_t> EspToolQt::serialReadOneFrame(int timeout_ms) {
     QTime timeout = QTime::currentTime().addMSecs(timeout_ms);
     vector<uint8_t> data;
@@ -514,15 +617,15 @@ vector<uint8_t> EspToolQt::serialReadOneFrame(int timeout_ms) {
     while(QTime::currentTime().msecsTo(timeout) > 0)
     {
         if (isCancelled()) return zero;
-        if (!serial->waitForReadyRead(1) && (!serial->isOpen() || hasSerialError())) {
+        if (!io()->waitForReadyRead(1) && (!io()->isOpen() || hasSerialError())) {
             qInfo() << "[ERROR] Serial frame wait failed:" << serialErrorString();
             closePort();
             return zero;
         }
         while(QTime::currentTime().msecsTo(timeout) > 0){
             if (isCancelled()) return zero;
-            QByteArray one_byte = serial->read(1);
-            if (!serial->isOpen() || hasSerialError()) {
+            QByteArray one_byte = io()->read(1);
+            if (!io()->isOpen() || hasSerialError()) {
                 qInfo() << "[ERROR] Serial frame read failed:" << serialErrorString();
                 closePort();
                 return zero;
@@ -593,14 +696,14 @@ vector<uint8_t> EspToolQt::serialReadOneFrameBuffered(int timeout_ms) {
         if (pos >= serial_frame_buffer_.size()) {
             serial_frame_buffer_.clear();
             pos = 0;
-            if (!serial->waitForReadyRead(1) && (!serial->isOpen() || hasSerialError())) {
+            if (!io()->waitForReadyRead(1) && (!io()->isOpen() || hasSerialError())) {
                 qInfo() << "[ERROR] Serial frame wait failed:" << serialErrorString();
                 closePort();
                 return zero;
             }
 
-            serial_frame_buffer_ = serial->readAll();
-            if (!serial->isOpen() || hasSerialError()) {
+            serial_frame_buffer_ = io()->readAll();
+            if (!io()->isOpen() || hasSerialError()) {
                 qInfo() << "[ERROR] Serial frame read failed:" << serialErrorString();
                 closePort();
                 return zero;
@@ -674,7 +777,9 @@ bool EspToolQt::syncWithRomBootloader(int attempts) {
     for (int i = 0; i < attempts; ++i) {
         if (isCancelled()) return false;
         if (diag) qInfo() << "[esp-diag] sync attempt start" << i;
-        serial->clear(QSerialPort::Input);
+        EspTrace::Span span = traceSpan("sync", "connect");
+        span.arg("attempt", i);
+        io()->clearInput();
         QElapsedTimer write_timer;
         write_timer.start();
         if (!serialWrite(sync_sequence, 100)) {
@@ -691,7 +796,10 @@ bool EspToolQt::syncWithRomBootloader(int attempts) {
             if (diag) qInfo() << "[esp-diag] sync frame wait start attempt" << i << "frame" << frame;
             QElapsedTimer frame_timer;
             frame_timer.start();
-            vector<uint8_t> reply = serialReadOneFrame(100);
+            const quint64 wire_bytes = sync_sequence.size() + ESP_REPLY_WIRE_BYTES;
+            vector<uint8_t> reply = serialReadOneFrame(replyTimeout(ESP_SYNC, 100, wire_bytes));
+            // only the first reply times the exchange, silence is normal while probing
+            if (frame == 0 && !reply.empty()) replySample(ESP_SYNC, write_timer.elapsed(), wire_bytes, true);
             if (diag) qInfo() << "[esp-diag] sync frame wait end attempt" << i << "frame" << frame
                               << "reply_size" << reply.size()
                               << "elapsed_ms" << frame_timer.elapsed();
@@ -723,6 +831,8 @@ static bool isEspressifUsbPort(const QString &portName)
 
 bool EspToolQt::autoConnect(QString port, uint32_t baud) {
     const bool diag = isDiagEnabled();
+    EspTrace::Span span = traceSpan("connect", "session");
+    span.arg("baud", baud);
 
     // Variant A: do not tear down a live, healthy session on a repeated connect.
     // On native USB-CDC parts (ESP32-S2/S3 USB-OTG) closing the working port and
@@ -731,13 +841,13 @@ bool EspToolQt::autoConnect(QString port, uint32_t baud) {
     // it. If we are already connected on the requested port/baud and the stub
     // still answers a register read, reuse the open handle instead of close+open.
     if (!isCancelled()
-        && serial != NULL && serial->isOpen() && isSerialUsable()
+        && isSerialUsable()
         && esp_target_info.connected && target != NULL
         && static_cast<uint32_t>(serial->baudRate()) == baud
         && (port.isEmpty() || port == esp_target_info.com_port)) {
         if (diag) qInfo() << "[esp-diag] autoConnect live-session probe" << esp_target_info.com_port
                           << "baud" << baud << serialDiagState(serial);
-        serial->clear();
+        io()->clear();
         const uint32_t magic = read_reg(0x40001000);
         if (!isCancelled() && target->CHIP_COMPARE_MAGIC_VALUE(magic)) {
             qInfo() << "ESP : reusing live session on" << esp_target_info.com_port
@@ -752,6 +862,7 @@ bool EspToolQt::autoConnect(QString port, uint32_t baud) {
     esp_target_info.connected = false;
     target = NULL;
     lastConnectError.clear();
+    rto_.reset();
     if (diag) qInfo() << "[esp-diag] autoConnect start requested_port" << port
                       << "baud" << baud
                       << serialDiagState(serial)
@@ -836,7 +947,7 @@ bool EspToolQt::autoConnect(QString port, uint32_t baud) {
                                       .arg(*port)
                                       .arg(static_cast<int>(reset));
                 qInfo() << last_sync_error;
-                serial->clear(QSerialPort::AllDirections);
+                io()->clear();
                 serialRead(200);
                 if (done) break;
                 closePort();
@@ -978,6 +1089,7 @@ bool EspToolQt::autoConnect(QString port, uint32_t baud) {
 }
 
 bool EspToolQt::stubUpload() {
+    EspTrace::Span span = traceSpan("stub_upload", "connect");
     uint32_t max_packet_size = target->ESP_RAM_BLOCK((void*)this);
 
     if (!mem_begin(target->stub_text().size(), target->stub_text_start(), max_packet_size)) {
@@ -1010,19 +1122,25 @@ bool EspToolQt::stubUpload() {
 }
 
 bool EspToolQt::changeBaud(uint32_t baud){
+    EspTrace::Span span = traceSpan("baud_change", "connect");
+    span.arg("baud", baud);
     vector<uint8_t> data_field;
     appendU32(&data_field, (uint32_t)baud);
     appendU32(&data_field, (uint32_t)serial->baudRate());
     vector<uint8_t> packet = slip_encode(0x0f, data_field);
+    const quint64 wire_bytes = packet.size() + ESP_REPLY_WIRE_BYTES;
+    QElapsedTimer timer;
+    timer.start();
     serialWrite(packet);
-    vector<uint8_t> reply = serialReadOneFrame();
+    vector<uint8_t> reply = serialReadOneFrame(replyTimeout(0x0f, 1000, wire_bytes));
+    replySample(0x0f, timer.elapsed(), wire_bytes, !reply.empty());
     if (isCancelled()) {
         closePort();
         return false;
     }
     serial->setBaudRate(baud);
     QObject().thread()->msleep(50);
-    serial->clear();
+    io()->clear();
 
     // determine chip id
     uint32_t x = read_reg(0x40001000);
@@ -1035,6 +1153,123 @@ bool EspToolQt::changeBaud(uint32_t baud){
     }
 }
 
+// Walk up a ladder of baud rates and keep the fastest one that survives a real
+// flash read. Each rate is validated with a short windowed fast read of flash
+// offset 0, which is MD5 checked, so a rate that only answers read_reg() but
+// corrupts bulk traffic is rejected. After a failing rate the link is put
+// back to the last clean one and the remaining rates are still tried.
+uint32_t EspToolQt::changeBaudToFastest(vector<uint32_t> candidates, uint32_t probe_size) {
+    lastBaudProbe.clear();
+
+    // check that target is connected
+    if (target == NULL || !isSerialUsable()) {
+        qInfo() << "[Error] Target is not connected";
+        return 0;
+    }
+
+    if (probe_size == 0) probe_size = target->FLASH_SECTOR_SIZE();
+    uint32_t good_baud = serial->baudRate();
+
+    // probes should not move the caller's progress bar
+    const bool progress_signal_was_enabled = progress_signal_enabled;
+    const bool serial_progress_was_enabled = serial_progress_enabled;
+    const bool progress_bytes_was_enabled = progress_bytes_enabled;
+    progress_signal_enabled = false;
+    serial_progress_enabled = false;
+    progress_bytes_enabled = false;
+
+    // Probe with the windowed fast read so the rate measured is the bulk
+    // rate. A probe that fails mid-stream leaves the stub inside its read
+    // loop, where anything we send is taken as an ACK, so the stream is
+    // ended before the caller talks to the stub again.
+    auto probe = [&](uint32_t baud) -> BaudProbeResult {
+        BaudProbeResult result;
+        result.baud = baud;
+        QElapsedTimer timer;
+        timer.start();
+        vector<uint8_t> data;
+        const FastReadStatus status = readFlashFastRange(0, probe_size, 64, data);
+        const int elapsed_ms = static_cast<int>(timer.elapsed());
+        result.ok = status == FastReadStatus::Ok && data.size() == probe_size;
+        if (result.ok) result.kbit_s = kbitPerSecond(data.size(), elapsed_ms);
+        if (status != FastReadStatus::Ok && status != FastReadStatus::Md5Mismatch && status != FastReadStatus::Cancelled) {
+            recoverFastReadLink(probe_size, 64);
+        }
+        return result;
+    };
+
+    // Put the link back to a known good rate. First ask the stub to switch
+    // back; if the stub never switched (or did not understand us), the host
+    // side alone is moved back and checked against the chip magic.
+    auto restore = [&](uint32_t baud) -> bool {
+        serialRead(100);
+        if (!isSerialUsable() || isCancelled()) return false;
+        if (changeBaud(baud)) return true;
+        if (!isSerialUsable() || isCancelled()) return false;
+        serial->setBaudRate(baud);
+        QThread::msleep(50);
+        io()->clear();
+        return target->CHIP_COMPARE_MAGIC_VALUE(read_reg(target->CHIP_DETECT_MAGIC_REG_ADDR()));
+    };
+
+    // baseline at the current rate
+    BaudProbeResult baseline = probe(good_baud);
+    lastBaudProbe.push_back(baseline);
+    if (baseline.ok) {
+        qInfo() << "[OK] Baud probe" << baseline.baud << "clean effective [kbit/s]:" << baseline.kbit_s;
+    }
+
+    if (!baseline.ok) {
+        progress_signal_enabled = progress_signal_was_enabled;
+        serial_progress_enabled = serial_progress_was_enabled;
+        progress_bytes_enabled = progress_bytes_was_enabled;
+        qInfo() << "[ERROR] Baud probe failed at current baudrate" << good_baud;
+        return 0;
+    }
+
+    // A failing rate does not end the ladder: some adapters reject one
+    // divisor and run clean at the next one up.
+    std::sort(candidates.begin(), candidates.end());
+    bool link_ok = true;
+    for (uint32_t baud : candidates) {
+        if (isCancelled()) break;
+        if (baud <= good_baud) continue;
+
+        BaudProbeResult result;
+        result.baud = baud;
+        if (changeBaud(baud)) {
+            result = probe(baud);
+        }
+        lastBaudProbe.push_back(result);
+
+        if (!result.ok) {
+            qInfo() << "[WARNING] Baud probe" << result.baud << "failed";
+            link_ok = restore(good_baud);
+            if (!link_ok) break;
+            continue;
+        }
+        qInfo() << "[OK] Baud probe" << result.baud << "clean effective [kbit/s]:" << result.kbit_s;
+        good_baud = baud;
+    }
+
+    progress_signal_enabled = progress_signal_was_enabled;
+    serial_progress_enabled = serial_progress_was_enabled;
+    progress_bytes_enabled = progress_bytes_was_enabled;
+
+    if (isCancelled()) {
+        closePort();
+        return 0;
+    }
+    if (!link_ok) {
+        qInfo() << "[ERROR] Baud probe lost the link";
+        closePort();
+        return 0;
+    }
+
+    qInfo() << "[OK] Fastest clean baudrate:" << good_baud;
+    return good_baud;
+}
+
 void EspToolQt::disconnect() {
     closePort();
     qInfo() << "Serial port closed";
@@ -1075,21 +1310,34 @@ vector<uint8_t> EspToolQt::slip_encode (uint8_t command, vector<uint8_t>data, ui
     return encoded_slip;
 }
 
-bool EspToolQt::slipCommandSend (uint8_t command, std::vector<uint8_t>data_field, uint32_t checksum, uint32_t timeout_ms) {
+bool EspToolQt::slipCommandSend (uint8_t command, std::vector<uint8_t>data_field, uint32_t checksum, uint32_t timeout_ms, double work) {
+    return slipCommandStatus(command, data_field, checksum, timeout_ms, work) == CommandStatus::Ok;
+}
+
+// Like slipCommandSend(), but tells an explicit error reply apart from no
+// reply at all. Only after an explicit reply is the link known to be in step.
+CommandStatus EspToolQt::slipCommandStatus(uint8_t command, const std::vector<uint8_t>& data_field, uint32_t checksum, uint32_t timeout_ms, double work) {
+    EspTrace::Span span = traceSpan("command", "command");
+    span.arg("op", command);
     vector<uint8_t> packet = slip_encode(command, data_field, checksum);
+    const quint64 wire_bytes = packet.size() + ESP_REPLY_WIRE_BYTES;
+    QElapsedTimer timer;
+    timer.start();
     serialWrite(packet);
-    vector<uint8_t> reply = serialReadOneFrame(timeout_ms);
+    vector<uint8_t> reply = serialReadOneFrame(replyTimeout(command, timeout_ms, wire_bytes, work));
+    replySample(command, timer.elapsed(), wire_bytes, !reply.empty(), work);
     if (isCancelled()) {
         closePort();
-        return false;
+        return CommandStatus::NoReply;
     }
     SlipReply slip_reply = slip_parse(reply);
-    if (slip_reply.valid && slip_reply.command == command && slip_reply.data[0] == 0)
-    {
-        return true;
-    } else {
-        return false;
+    if (!slip_reply.valid || slip_reply.command != command || slip_reply.data.empty()) return CommandStatus::NoReply;
+    if (slip_reply.data[0] == 0) return CommandStatus::Ok;
+    if (slip_reply.data.size() >= 2
+        && (slip_reply.data[1] == ESP_ERROR_INVALID_MESSAGE || slip_reply.data[1] == ESP_ERROR_CMD_NOT_IMPLEMENTED)) {
+        return CommandStatus::Unsupported;
     }
+    return CommandStatus::Failed;
 }
 
 std::vector<uint8_t> EspToolQt::slip_raw_encode (std::vector<uint8_t>& unencoded_vec) {
@@ -1163,21 +1411,7 @@ bool EspToolQt::mem_begin(uint32_t size_of_data, uint32_t memory_offset, uint32_
     appendU32(&data_field, number_of_data_packets);
     appendU32(&data_field, max_packet_size);
     appendU32(&data_field, memory_offset);
-    vector<uint8_t> packet = slip_encode(ESP_MEM_BEGIN, data_field);
-    serialWrite(packet);
-    vector<uint8_t> reply = serialReadOneFrame();
-    if (isCancelled()) {
-        closePort();
-        return false;
-    }
-    SlipReply slip_reply = slip_parse(reply);
-    if (slip_reply.valid && slip_reply.command == ESP_MEM_BEGIN && slip_reply.data[0] == 0)
-    {
-        return true;
-    } else {
-        return false;
-    }
-
+    return slipCommandSend(ESP_MEM_BEGIN, data_field);
 }
 
 bool EspToolQt::mem_data_one_block(uint32_t sequence_number, const vector<uint8_t>& data) {
@@ -1189,21 +1423,7 @@ bool EspToolQt::mem_data_one_block(uint32_t sequence_number, const vector<uint8_
     appendU32(&data_field, zero);
     appendU32(&data_field, zero);
     data_field.insert(data_field.end(), data.begin(), data.end());
-    vector<uint8_t> packet = slip_encode(ESP_MEM_DATA, data_field, checksum);
-    serialWrite(packet);
-    vector<uint8_t> reply = serialReadOneFrame();
-    if (isCancelled()) {
-        closePort();
-        return false;
-    }
-    SlipReply slip_reply = slip_parse(reply);
-    if (slip_reply.valid && slip_reply.command == ESP_MEM_DATA && slip_reply.data[0] == 0)
-    {
-        return true;
-    } else {
-        return false;
-    }
-
+    return slipCommandSend(ESP_MEM_DATA, data_field, checksum);
 }
 
 bool EspToolQt::mem_data(vector<uint8_t> data, uint32_t max_packet_size) {
@@ -1242,7 +1462,10 @@ bool EspToolQt::mem_end(uint32_t entry_address) {
     appendU32(&data_field, entry_address);
     if (!slipCommandSend(ESP_MEM_END, data_field)) return false;
 
-    vector<uint8_t> ohai = serialReadOneFrame();
+    QElapsedTimer timer;
+    timer.start();
+    vector<uint8_t> ohai = serialReadOneFrame(replyTimeout(ESP_RTO_STUB_GREETING, 1000, ESP_REPLY_WIRE_BYTES));
+    replySample(ESP_RTO_STUB_GREETING, timer.elapsed(), ESP_REPLY_WIRE_BYTES, !ohai.empty());
     if (isCancelled()) {
         closePort();
         return false;
@@ -1267,12 +1490,12 @@ std::vector<uint8_t> EspToolQt::readFlash(uint32_t offset, uint32_t size) {
     vector<uint8_t> zero;
 
     // check that target is connected
-    if (target == NULL || serial == NULL || !serial->isOpen()) {
+    if (target == NULL || !io()->isOpen()) {
         qInfo() << "[Error] Target is not connected";
         return zero;
     }
 
-    progress(0);
+    readProgress(0, size);
 
     vector<uint8_t> data_field;
     appendU32(&data_field, offset);
@@ -1282,26 +1505,30 @@ std::vector<uint8_t> EspToolQt::readFlash(uint32_t offset, uint32_t size) {
     vector<uint8_t> packet = slip_encode(0xD2, data_field);
     serialWrite(packet);
     QTime lap = QTime::currentTime();
-    vector<uint8_t> reply = serialReadOneFrame(); // read reply to command
+    vector<uint8_t> reply = serialReadOneFrame(replyTimeout(0xD2, 1000, packet.size() + ESP_REPLY_WIRE_BYTES)); // read reply to command
     command_reply_ms = lap.msecsTo(QTime::currentTime());
+    replySample(0xD2, command_reply_ms, packet.size() + ESP_REPLY_WIRE_BYTES, !reply.empty());
     if (isCancelled()) {
         closePort();
         return zero;
     }
     if (reply.size() == 0) return zero;
 
+    // a frame plus the 6 byte ack that released it
+    const quint64 frame_wire_bytes = target->FLASH_SECTOR_SIZE() + 2 + 6;
     while (received_data.size() < size) {
         if (isCancelled()) {
             closePort();
             return zero;
         }
-        progress((float)received_data.size() / (float)size * 100);
-        if (progress_bytes_enabled)
-            emit progress_bytes_signal(received_data.size(), size);
+        readProgress(received_data.size(), size);
 
+        // one frame per ack, so each frame is a real round trip
         lap = QTime::currentTime();
-        vector<uint8_t> reply = serialReadOneFrame();
-        data_frames_ms += lap.msecsTo(QTime::currentTime());
+        vector<uint8_t> reply = serialReadOneFrame(replyTimeout(ESP_RTO_READ_FRAME, 1000, frame_wire_bytes));
+        const int frame_ms = lap.msecsTo(QTime::currentTime());
+        replySample(ESP_RTO_READ_FRAME, frame_ms, frame_wire_bytes, !reply.empty());
+        data_frames_ms += frame_ms;
         if (isCancelled()) {
             closePort();
             return zero;
@@ -1326,13 +1553,14 @@ std::vector<uint8_t> EspToolQt::readFlash(uint32_t offset, uint32_t size) {
         ack_count++;
     }
 
-    progress(100);
+    readProgress(size, size);
     int transfer_ms = start.msecsTo(QTime::currentTime());
     if (transfer_ms <= 0) transfer_ms = 1;
 
     lap = QTime::currentTime();
-    vector<uint8_t> md5_from_esp = serialReadOneFrame();
+    vector<uint8_t> md5_from_esp = serialReadOneFrame(replyTimeout(ESP_RTO_READ_FRAME, 1000, 18 + 6));
     md5_frame_ms = lap.msecsTo(QTime::currentTime());
+    replySample(ESP_RTO_READ_FRAME, md5_frame_ms, 18 + 6, !md5_from_esp.empty());
     if (isCancelled()) {
         closePort();
         return zero;
@@ -1378,7 +1606,23 @@ std::vector<uint8_t> EspToolQt::readFlash(uint32_t offset, uint32_t size) {
 }
 
 std::vector<uint8_t> EspToolQt::readFlashFast(uint32_t offset, uint32_t size, uint32_t max_in_flight) {
+    vector<uint8_t> received_data;
+    if (readFlashFastRange(offset, size, max_in_flight, received_data) != FastReadStatus::Ok) {
+        closePort();
+        serial_frame_buffer_.clear();
+        return {};
+    }
+    return received_data;
+}
+
+// One 0xD2 fast read. Returns the reason it stopped; on failure
+// received_data keeps every complete frame that arrived before the error, so
+// callers can salvage it. The port is only closed on cancel or serial errors.
+EspToolQt::FastReadStatus EspToolQt::readFlashFastRange(uint32_t offset, uint32_t size, uint32_t max_in_flight, vector<uint8_t>& received_data) {
     QTime start = QTime::currentTime();
+    EspTrace::Span span = traceSpan("read_range", "read");
+    span.arg("offset", offset);
+    span.arg("size", size);
     const bool diag = isDiagEnabled();
     int command_reply_ms = 0;
     int data_frames_ms = 0;
@@ -1396,36 +1640,56 @@ std::vector<uint8_t> EspToolQt::readFlashFast(uint32_t offset, uint32_t size, ui
     quint64 last_diag_bytes = 0;
     QTime last_diag_time = start;
 
-    vector<uint8_t> received_data;
-    vector<uint8_t> zero;
-    auto fail_fast_read = [&]() -> vector<uint8_t> {
-        closePort();
+    received_data.clear();
+    auto publish_stats = [&](int transfer_ms) {
+        lastFastReadStats = FastReadStats();
+        lastFastReadStats.max_in_flight = max_in_flight;
+        lastFastReadStats.ack_every = fast_read_ack_every;
+        lastFastReadStats.frames = frame_count;
+        lastFastReadStats.acks = ack_count;
+        lastFastReadStats.payload_bytes = payload_bytes;
+        lastFastReadStats.transfer_ms = transfer_ms;
+        lastFastReadStats.cmd_reply_ms = command_reply_ms;
+        lastFastReadStats.data_frames_ms = data_frames_ms;
+        lastFastReadStats.ack_send_ms = ack_send_ms;
+        lastFastReadStats.first_frame_ms = first_frame_ms;
+        lastFastReadStats.max_frame_ms = max_frame_ms;
+        lastFastReadStats.max_ack_ms = max_ack_ms;
+        lastFastReadStats.slow_frame_count = slow_frame_count;
+        lastFastReadStats.slow_ack_count = slow_ack_count;
+        lastFastReadStats.kbit_s = kbitPerSecond(payload_bytes, transfer_ms);
+    };
+    auto fail_fast_read = [&](FastReadStatus status) -> FastReadStatus {
+        publish_stats(start.msecsTo(QTime::currentTime()));
         serial_frame_buffer_.clear();
-        return zero;
+        return status;
     };
 
-    if (target == NULL || serial == NULL || !serial->isOpen()) {
+    if (target == NULL || !io()->isOpen()) {
         qInfo() << "[Error] Target is not connected";
-        return zero;
+        return FastReadStatus::CommandFailed;
     }
 
     if (max_in_flight == 0) max_in_flight = 1;
     serial_frame_buffer_.clear();
-    serial->clear(QSerialPort::Input);
+    io()->clearInput();
 
-    progress(0);
+    readProgress(0, size);
     qInfo() << "[OK] ESP fast read enabled, max_in_flight:" << max_in_flight;
     if (diag) {
         const qint64 baud = serial ? serial->baudRate() : 0;
         const QString chip = target ? target->CHIP_NAME() : QStringLiteral("unknown");
         const uint32_t sector_size = target ? target->FLASH_SECTOR_SIZE() : 0;
-        qInfo().noquote() << QString("[esp-diag] fast_read_start chip=%1 baud=%2 offset=0x%3 size=%4 sector=%5 max_in_flight=%6")
+        qInfo().noquote() << QString("[esp-diag] fast_read_start chip=%1 baud=%2 offset=0x%3 size=%4 sector=%5 max_in_flight=%6 ack_every=%7 ack_max_delay_ms=%8 ack_async=%9")
             .arg(chip)
             .arg(baud)
             .arg(QString::number(offset, 16).toUpper())
             .arg(static_cast<qulonglong>(size))
             .arg(sector_size)
-            .arg(max_in_flight);
+            .arg(max_in_flight)
+            .arg(fast_read_ack_every)
+            .arg(fast_read_ack_max_delay_ms)
+            .arg(fast_read_ack_async ? "yes" : "no");
     }
 
     vector<uint8_t> data_field;
@@ -1435,32 +1699,42 @@ std::vector<uint8_t> EspToolQt::readFlashFast(uint32_t offset, uint32_t size, ui
     appendU32(&data_field, max_in_flight);
     vector<uint8_t> packet = slip_encode(0xD2, data_field);
     if (!serialWriteWithoutInputClear(packet)) {
-        return fail_fast_read();
+        return fail_fast_read(FastReadStatus::CommandFailed);
     }
     QTime lap = QTime::currentTime();
-    vector<uint8_t> reply = serialReadOneFrameBuffered();
+    const bool reply_buffered = !serial_frame_buffer_.isEmpty();
+    vector<uint8_t> reply = serialReadOneFrameBuffered(replyTimeout(0xD2, 1000, packet.size() + ESP_REPLY_WIRE_BYTES));
     command_reply_ms = lap.msecsTo(QTime::currentTime());
+    if (!reply_buffered) replySample(0xD2, command_reply_ms, packet.size() + ESP_REPLY_WIRE_BYTES, !reply.empty());
     if (isCancelled()) {
         closePort();
-        return zero;
+        return FastReadStatus::Cancelled;
     }
     SlipReply slip_reply = slip_parse(reply);
     if (!slip_reply.valid || slip_reply.command != 0xD2 || slip_reply.data.empty() || slip_reply.data[0] != 0) {
         qInfo() << "[ERROR] ESP fast read command failed";
-        return fail_fast_read();
+        return fail_fast_read(FastReadStatus::CommandFailed);
     }
 
+    // Never hold back more than half of the device window, otherwise the stub
+    // runs out of credit and stops sending before our next ACK.
+    const uint32_t ack_every = std::max<uint32_t>(1, std::min<uint32_t>(fast_read_ack_every, max_in_flight / 2));
+    uint32_t frames_since_ack = 0;
+    QTime last_ack_time = QTime::currentTime();
+    const quint64 frame_wire_bytes = target->FLASH_SECTOR_SIZE() + 2;
+
     while (received_data.size() < size) {
         if (isCancelled()) {
             closePort();
-            return zero;
+            return FastReadStatus::Cancelled;
         }
-        progress((float)received_data.size() / (float)size * 100);
-        if (progress_bytes_enabled)
-            emit progress_bytes_signal(received_data.size(), size);
+        readProgress(received_data.size(), size);
 
         lap = QTime::currentTime();
-        vector<uint8_t> reply = serialReadOneFrameBuffered();
+        // data frames stream in behind each other and are mostly read from
+        // the buffer, their times say nothing about the reply latency: use
+        // what stop-and-wait reads learned, without sampling
+        vector<uint8_t> reply = serialReadOneFrameBuffered(replyTimeout(ESP_RTO_READ_FRAME, 1000, frame_wire_bytes));
         const int frame_ms = lap.msecsTo(QTime::currentTime());
         data_frames_ms += frame_ms;
         if (frame_count == 0) first_frame_ms = frame_ms;
@@ -1468,35 +1742,52 @@ std::vector<uint8_t> EspToolQt::readFlashFast(uint32_t offset, uint32_t size, ui
         if (frame_ms > 100) slow_frame_count++;
         if (isCancelled()) {
             closePort();
-            return zero;
+            return FastReadStatus::Cancelled;
         }
-        if (reply.size() == 0) return fail_fast_read();
-        frame_count++;
-        payload_bytes += static_cast<quint64>(reply.size());
+        if (reply.size() == 0) return fail_fast_read(FastReadStatus::FrameError);
 
-        received_data.insert(received_data.end(), reply.begin(), reply.end());
-
-        if (received_data.size() < size && reply.size() != target->FLASH_SECTOR_SIZE()) {
+        // validate the frame before keeping it, so received_data only ever
+        // holds whole sectors
+        const size_t received_after = received_data.size() + reply.size();
+        if (received_after < size && reply.size() != target->FLASH_SECTOR_SIZE()) {
             qInfo() << "Inbound data packet too small";
-            return fail_fast_read();
+            return fail_fast_read(FastReadStatus::FrameError);
         }
-        if (received_data.size() > size) {
+        if (received_after > size) {
             qInfo() << "Inbound data packet too large";
-            return fail_fast_read();
+            return fail_fast_read(FastReadStatus::FrameError);
         }
+        frame_count++;
+        payload_bytes += static_cast<quint64>(reply.size());
 
-        vector<uint8_t> ack;
-        appendU32(&ack, received_data.size());
-        vector<uint8_t> encoded_ack = slip_raw_encode(ack);
-        lap = QTime::currentTime();
-        if (!serialWriteWithoutInputClear(encoded_ack)) {
-            return fail_fast_read();
+        received_data.insert(received_data.end(), reply.begin(), reply.end());
+
+        // ACKs carry the total byte count, so one ACK covers every frame
+        // received before it. The last frame is always acknowledged (the stub
+        // sends its MD5 only after that) and goes out blocking.
+        frames_since_ack++;
+        const bool last_frame = received_data.size() == size;
+        int ack_ms = 0;
+        if (last_frame || frames_since_ack >= ack_every
+            || last_ack_time.msecsTo(QTime::currentTime()) >= fast_read_ack_max_delay_ms) {
+            vector<uint8_t> ack;
+            appendU32(&ack, received_data.size());
+            vector<uint8_t> encoded_ack = slip_raw_encode(ack);
+            lap = QTime::currentTime();
+            const bool ack_written = (fast_read_ack_async && !last_frame)
+                ? serialWriteNoWait(encoded_ack)
+                : serialWriteWithoutInputClear(encoded_ack);
+            if (!ack_written) {
+                return fail_fast_read(FastReadStatus::FrameError);
+            }
+            ack_ms = lap.msecsTo(QTime::currentTime());
+            ack_send_ms += ack_ms;
+            if (ack_ms > max_ack_ms) max_ack_ms = ack_ms;
+            if (ack_ms > 20) slow_ack_count++;
+            ack_count++;
+            frames_since_ack = 0;
+            last_ack_time = QTime::currentTime();
         }
-        const int ack_ms = lap.msecsTo(QTime::currentTime());
-        ack_send_ms += ack_ms;
-        if (ack_ms > max_ack_ms) max_ack_ms = ack_ms;
-        if (ack_ms > 20) slow_ack_count++;
-        ack_count++;
 
         if (diag) {
             const int since_last_diag_ms = last_diag_time.msecsTo(QTime::currentTime());
@@ -1525,16 +1816,18 @@ std::vector<uint8_t> EspToolQt::readFlashFast(uint32_t offset, uint32_t size, ui
         }
     }
 
-    progress(100);
+    readProgress(size, size);
     int transfer_ms = start.msecsTo(QTime::currentTime());
     if (transfer_ms <= 0) transfer_ms = 1;
 
+    publish_stats(transfer_ms);
+
     lap = QTime::currentTime();
-    vector<uint8_t> md5_from_esp = serialReadOneFrameBuffered();
+    vector<uint8_t> md5_from_esp = serialReadOneFrameBuffered(replyTimeout(ESP_RTO_READ_FRAME, 1000, 18));
     md5_frame_ms = lap.msecsTo(QTime::currentTime());
     if (isCancelled()) {
         closePort();
-        return zero;
+        return FastReadStatus::Cancelled;
     }
 
     lap = QTime::currentTime();
@@ -1545,7 +1838,7 @@ std::vector<uint8_t> EspToolQt::readFlashFast(uint32_t offset, uint32_t size, ui
         qInfo() << "[OK] MD5 Check Passed";
     } else {
         qInfo() << "[ERROR] MD5 Check Failed";
-        return fail_fast_read();
+        return fail_fast_read(FastReadStatus::Md5Mismatch);
     }
 
     int total_ms = start.msecsTo(QTime::currentTime());
@@ -1576,9 +1869,302 @@ std::vector<uint8_t> EspToolQt::readFlashFast(uint32_t offset, uint32_t size, ui
             .arg(max_ack_ms)
             .arg(slow_frame_count)
             .arg(slow_ack_count);
+        logRtoDiag();
     }
 
-    return received_data;
+    return FastReadStatus::Ok;
+}
+
+// Fast read with a window picked from the link instead of by hand.
+//
+// A short probe segment is read with a conservative window. Its timings give
+// the average frame inter-arrival time and the command-to-first-frame latency;
+// the window is sized to cover that latency a couple of times over. The rest of
+// the range is read in segments, each with a fresh 0xD2 command, so the window
+// can be halved when a segment shows slow frames or ACK stalls and grown again
+// while the link stays clean.
+std::vector<uint8_t> EspToolQt::readFlashFastAdaptive(uint32_t offset, uint32_t size) {
+    const uint32_t PROBE_WINDOW = 8;
+    const uint32_t MIN_WINDOW = 2;
+    const uint32_t MAX_WINDOW = 128;
+    const uint32_t SEGMENT_SIZE = 1024 * 1024;
+
+    lastAdaptiveReadStats = AdaptiveReadStats();
+    vector<uint8_t> received_data;
+    vector<uint8_t> zero;
+
+    if (target == NULL || !io()->isOpen()) {
+        qInfo() << "[Error] Target is not connected";
+        return zero;
+    }
+
+    const uint32_t sector_size = target->FLASH_SECTOR_SIZE();
+    const uint32_t probe_size = std::min<uint32_t>(size, 16 * sector_size);
+    received_data.reserve(size);
+
+    read_progress_base_ = 0;
+    read_progress_total_ = size;
+    auto finish = [&](vector<uint8_t> result) -> vector<uint8_t> {
+        read_progress_base_ = 0;
+        read_progress_total_ = 0;
+        return result;
+    };
+
+    // Read one segment. A failed segment is retried with a halved window
+    // after the stream is ended like readFlashResilient() does; only a link
+    // that does not come back ends the whole read.
+    const int SEGMENT_ATTEMPTS = 3;
+    auto read_segment = [&](uint32_t segment_offset, uint32_t segment_size, uint32_t& segment_window) -> vector<uint8_t> {
+        for (int attempt = 0; attempt < SEGMENT_ATTEMPTS; ++attempt) {
+            vector<uint8_t> part;
+            const FastReadStatus status = readFlashFastRange(segment_offset, segment_size, segment_window, part);
+            if (status == FastReadStatus::Ok) return part;
+            if (status == FastReadStatus::Cancelled) return zero;
+            qInfo().noquote() << QString("[WARNING] Adaptive read segment at 0x%1 failed, retrying")
+                .arg(QString::number(segment_offset, 16).toUpper());
+            if (status != FastReadStatus::Md5Mismatch && !recoverFastReadLink(segment_size, segment_window)) {
+                closePort();
+                return zero;
+            }
+            segment_window = std::max(MIN_WINDOW, segment_window / 2);
+            lastAdaptiveReadStats.degrade_count++;
+        }
+        return zero;
+    };
+
+    // probe segment
+    uint32_t probe_window = PROBE_WINDOW;
+    vector<uint8_t> segment = read_segment(offset, probe_size, probe_window);
+    if (segment.size() != probe_size) return finish(zero);
+    appendVec(received_data, segment);
+    lastAdaptiveReadStats.probe_window = PROBE_WINDOW;
+    lastAdaptiveReadStats.windows.push_back(PROBE_WINDOW);
+    lastAdaptiveReadStats.segments++;
+
+    const FastReadStats probe = lastFastReadStats;
+    const double frame_ms = probe.frames == 0 ? 1.0
+        : std::max(1.0, static_cast<double>(probe.transfer_ms) / static_cast<double>(probe.frames));
+    const double latency_ms = std::max<double>(probe.first_frame_ms, probe.max_ack_ms);
+    uint32_t window = static_cast<uint32_t>(ceil(latency_ms / frame_ms)) * 2 + 2;
+    if (probe.slow_frame_count != 0) window = PROBE_WINDOW / 2;
+    window = std::max(MIN_WINDOW, std::min(MAX_WINDOW, window));
+    lastAdaptiveReadStats.chosen_window = window;
+    qInfo() << "[OK] ESP adaptive read window:" << window
+            << "frame_ms:" << frame_ms << "latency_ms:" << latency_ms;
+
+    double best_kbit_s = probe.kbit_s;
+    while (received_data.size() < size) {
+        if (isCancelled()) {
+            closePort();
+            return finish(zero);
+        }
+        const uint32_t done = received_data.size();
+        const uint32_t segment_size = std::min<uint32_t>(size - done, SEGMENT_SIZE);
+        read_progress_base_ = done;
+
+        segment = read_segment(offset + done, segment_size, window);
+        if (segment.size() != segment_size) return finish(zero);
+        appendVec(received_data, segment);
+        lastAdaptiveReadStats.windows.push_back(window);
+        lastAdaptiveReadStats.segments++;
+
+        // degraded link: stalls or a clear drop in throughput, back off
+        const FastReadStats& stats = lastFastReadStats;
+        const bool stalled = stats.slow_frame_count != 0 || stats.slow_ack_count != 0;
+        const bool slower = best_kbit_s > 0 && stats.kbit_s < best_kbit_s * 0.75;
+        if (stalled || slower) {
+            window = std::max(MIN_WINDOW, window / 2);
+            lastAdaptiveReadStats.degrade_count++;
+        } else {
+            if (stats.kbit_s > best_kbit_s) best_kbit_s = stats.kbit_s;
+            window = std::min(MAX_WINDOW, window + window / 4 + 1);
+        }
+        if (isDiagEnabled()) {
+            qInfo().noquote() << QString("[esp-diag] adaptive_read segment=%1 offset=0x%2 size=%3 window=%4 next_window=%5 kbit_s=%6 max_frame_ms=%7 max_ack_ms=%8 slow_frames=%9 slow_acks=%10")
+                .arg(lastAdaptiveReadStats.segments)
+                .arg(QString::number(offset + done, 16).toUpper())
+                .arg(segment_size)
+                .arg(stats.max_in_flight)
+                .arg(window)
+                .arg(stats.kbit_s, 0, 'f', 2)
+                .arg(stats.max_frame_ms)
+                .arg(stats.max_ack_ms)
+                .arg(stats.slow_frame_count)
+                .arg(stats.slow_ack_count);
+        }
+    }
+
+    qInfo() << "[OK] ESP adaptive read done, segments:" << lastAdaptiveReadStats.segments
+            << "degrades:" << lastAdaptiveReadStats.degrade_count;
+    return finish(received_data);
+}
+
+// End a fast read the stub is still streaming. Up to max_in_flight frames
+// can still be on their way, so the input is drained until the line has been
+// quiet for a few frame times rather than until the first short gap.
+bool EspToolQt::recoverFastReadLink(uint32_t range_size, uint32_t max_in_flight) {
+    serial_frame_buffer_.clear();
+    const uint32_t baud = std::max<uint32_t>(1, static_cast<uint32_t>(serial->baudRate()));
+    const int frame_ms = static_cast<int>(ceil(EspRtoEstimator::wireMs(target->FLASH_SECTOR_SIZE() + 16, baud)));
+    const int idle_ms = std::max(100, 2 * frame_ms);
+    const int drain_ms = static_cast<int>(std::max<uint32_t>(1, max_in_flight)) * frame_ms + 2 * idle_ms;
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        if (isCancelled() || !isSerialUsable()) return false;
+        serialDrain(idle_ms, drain_ms);
+        vector<uint8_t> ack;
+        appendU32(&ack, range_size);
+        vector<uint8_t> encoded_ack = slip_raw_encode(ack);
+        if (!serialWriteWithoutInputClear(encoded_ack)) return false;
+        serialDrain(idle_ms, drain_ms);
+        if (target->CHIP_COMPARE_MAGIC_VALUE(read_reg(target->CHIP_DETECT_MAGIC_REG_ADDR()))) {
+            return true;
+        }
+    }
+    qInfo() << "[ERROR] ESP link did not recover after read failure";
+    return false;
+}
+
+// Fast read that survives glitches.
+//
+// The range is read with one 0xD2 command as usual. When the read breaks off
+// (timeout, short frame) or the final MD5 does not match, the sectors that did
+// arrive are kept and checked against the device MD5 (0x13) chunk by chunk.
+// Only chunks that are missing or do not match are read again, each with a
+// fresh 0xD2 command, so a single glitch costs one chunk instead of the whole
+// transfer.
+std::vector<uint8_t> EspToolQt::readFlashResilient(uint32_t offset, uint32_t size, uint32_t max_in_flight) {
+    const uint32_t VERIFY_CHUNK_SECTORS = 16;
+    const int MAX_PASSES = 8;
+
+    vector<uint8_t> zero;
+
+    if (target == NULL || !io()->isOpen()) {
+        qInfo() << "[Error] Target is not connected";
+        return zero;
+    }
+
+    struct Range { uint32_t start; uint32_t size; };
+    const uint32_t sector_size = target->FLASH_SECTOR_SIZE();
+    const uint32_t chunk_size = sector_size * VERIFY_CHUNK_SECTORS;
+    const uint32_t sector_count = (size + sector_size - 1) / sector_size;
+
+    vector<uint8_t> image(size, 0xFF);
+    vector<bool> sector_ok(sector_count, false);
+    quint64 verified_bytes = 0;
+    quint64 reread_bytes = 0;
+    uint32_t window = max_in_flight == 0 ? 1 : max_in_flight;
+
+    auto mark_ok = [&](uint32_t start, uint32_t length) {
+        for (uint32_t sector = start / sector_size; sector * sector_size < start + length; ++sector) {
+            if (!sector_ok[sector]) {
+                sector_ok[sector] = true;
+                verified_bytes += std::min(sector_size, size - sector * sector_size);
+            }
+        }
+    };
+
+    // check a received, unconfirmed range against the device MD5 chunk by
+    // chunk; returns the chunks that need to be read again
+    auto verify_chunks = [&](uint32_t start, uint32_t length, std::vector<Range>& bad) -> bool {
+        for (uint32_t chunk = start; chunk < start + length; chunk += chunk_size) {
+            if (isCancelled()) return false;
+            const uint32_t chunk_len = std::min(chunk_size, start + length - chunk);
+            vector<uint8_t> md5_from_esp;
+            if (!readFlashMd5(offset + chunk, chunk_len, &md5_from_esp)) {
+                if (!isSerialUsable()) return false;
+                bad.push_back({chunk, chunk_len});
+                continue;
+            }
+            vector<uint8_t> host_chunk(image.begin() + chunk, image.begin() + chunk + chunk_len);
+            if (md5_from_esp == calculate_md5_hash(host_chunk)) {
+                mark_ok(chunk, chunk_len);
+            } else {
+                bad.push_back({chunk, chunk_len});
+            }
+        }
+        return true;
+    };
+
+    std::vector<Range> pending = {{0, size}};
+    read_progress_total_ = size;
+    auto finish = [&](vector<uint8_t> result) -> vector<uint8_t> {
+        read_progress_base_ = 0;
+        read_progress_total_ = 0;
+        return result;
+    };
+
+    for (int pass = 0; pass < MAX_PASSES && !pending.empty(); ++pass) {
+        std::vector<Range> next;
+        for (const Range& range : pending) {
+            if (isCancelled()) {
+                closePort();
+                return finish(zero);
+            }
+            if (pass != 0) {
+                reread_bytes += range.size;
+                qInfo().noquote() << QString("Re-reading flash range [0x%1-0x%2]")
+                    .arg(QString::number(offset + range.start, 16).toUpper())
+                    .arg(QString::number(offset + range.start + range.size, 16).toUpper());
+            }
+            read_progress_base_ = pass == 0 ? 0 : verified_bytes;
+
+            vector<uint8_t> part;
+            FastReadStatus status = readFlashFastRange(offset + range.start, range.size, window, part);
+            std::copy(part.begin(), part.end(), image.begin() + range.start);
+
+            if (status == FastReadStatus::Ok) {
+                mark_ok(range.start, range.size);
+                continue;
+            }
+            if (status == FastReadStatus::Cancelled) {
+                return finish(zero);
+            }
+
+            // the stub MD5 frame was already consumed on a mismatch; any other
+            // failure leaves the stub mid-read
+            if (status != FastReadStatus::Md5Mismatch) {
+                const uint32_t in_flight = window;
+                window = std::max<uint32_t>(1, window / 2);
+                if (!recoverFastReadLink(range.size, in_flight)) {
+                    closePort();
+                    return finish(zero);
+                }
+            }
+
+            // salvage whatever arrived, queue the rest
+            if (!verify_chunks(range.start, part.size(), next)) {
+                if (isCancelled()) closePort();
+                return finish(zero);
+            }
+            if (part.size() < range.size) {
+                const uint32_t missing_start = range.start + part.size();
+                const uint32_t missing_end = range.start + range.size;
+                for (uint32_t chunk = missing_start; chunk < missing_end; chunk += chunk_size) {
+                    next.push_back({chunk, std::min(chunk_size, missing_end - chunk)});
+                }
+            }
+        }
+        pending = next;
+    }
+
+    if (!pending.empty()) {
+        qInfo() << "[ERROR] Resilient read failed, unreadable ranges left:" << static_cast<int>(pending.size());
+        return finish(zero);
+    }
+
+    read_progress_base_ = 0;
+    read_progress_total_ = 0;
+    readProgress(size, size);
+    qInfo() << "[OK] Resilient read done, re-read bytes:" << reread_bytes;
+    if (isDiagEnabled()) {
+        qInfo().noquote() << QString("[esp-diag] resilient_read offset=0x%1 size=%2 sectors=%3 reread_bytes=%4 final_window=%5")
+            .arg(QString::number(offset, 16).toUpper())
+            .arg(size)
+            .arg(sector_count)
+            .arg(reread_bytes)
+            .arg(window);
+    }
+    return image;
 }
 
 std::vector<uint8_t> EspToolQt::readFlashWithAgent(uint32_t offset, uint32_t size) {
@@ -1596,6 +2182,9 @@ bool EspToolQt::flashBegin(uint32_t size_of_data, uint32_t number_of_data_packet
 }
 
 bool EspToolQt::flashDataOneBlock(uint32_t sequence_number, std::vector<uint8_t> &data, bool compressed) {
+    EspTrace::Span span = traceSpan("flash_data", "command");
+    span.arg("seq", sequence_number);
+    span.arg("size", static_cast<qint64>(data.size()));
     vector<uint8_t> data_field;
     uint32_t block_size = target->FLASH_WRITE_SIZE();
 
@@ -1614,20 +2203,134 @@ bool EspToolQt::flashDataOneBlock(uint32_t sequence_number, std::vector<uint8_t>
     return slipCommandSend((compressed) ? ESP_FLASH_DEFL_DATA : ESP_FLASH_DATA, data_field, hash, 5000);
 }
 
-// https://stackoverflow.com/questions/4538586/how-to-compress-a-buffer-with-zlib
-std::vector<uint8_t> compress_vector(const std::vector<uint8_t>& source) {
-    std::vector<uint8_t> destination;
-    unsigned long source_length = source.size();
-    unsigned long destination_length = compressBound(source_length);
-    destination.resize(destination_length);
+// Split data into runs of whole flash sectors that are fully erased (0xFF)
+// and runs of anything else. Partial sectors at either end always count as
+// data, so erased runs are sector aligned in flash. Erased runs shorter than
+// min_erased_run stay part of the data around them.
+struct FlashExtent { uint32_t start; uint32_t size; bool erased; };
+
+static std::vector<FlashExtent> flashExtents(uint32_t memory_offset, const std::vector<uint8_t>& data, uint32_t sector_size, uint32_t min_erased_run) {
+    std::vector<FlashExtent> extents;
+    auto add = [&extents](uint32_t start, uint32_t size, bool erased) {
+        if (size == 0) return;
+        if (!extents.empty() && extents.back().erased == erased) {
+            extents.back().size += size;
+        } else {
+            extents.push_back({start, size, erased});
+        }
+    };
+
+    const uint32_t size = data.size();
+    uint32_t pos = std::min(size, (sector_size - memory_offset % sector_size) % sector_size);
+    add(0, pos, false);
+    while (pos < size) {
+        const uint32_t len = std::min(sector_size, size - pos);
+        const bool erased = len == sector_size &&
+            std::all_of(data.begin() + pos, data.begin() + pos + len, [](uint8_t b) { return b == 0xFF; });
+        add(pos, len, erased);
+        pos += len;
+    }
+
+    std::vector<FlashExtent> merged;
+    for (FlashExtent extent : extents) {
+        if (extent.erased && extent.size < min_erased_run) extent.erased = false;
+        if (!merged.empty() && merged.back().erased == extent.erased) {
+            merged.back().size += extent.size;
+        } else {
+            merged.push_back(extent);
+        }
+    }
+    return merged;
+}
 
-    compress2((Bytef *) destination.data(), &destination_length, (Bytef *) source.data(), source_length, Z_BEST_COMPRESSION);
-    destination.resize(destination_length);
+// Deflate turns 0xFF runs into a few bytes on the wire, while every split
+// costs a flash begin, an erase and a final wait; only long runs pay off.
+uint32_t EspToolQt::erasedRunThreshold(bool compress) const {
+    return compress ? std::max(target->FLASH_SECTOR_SIZE(), skip_erased_min_compressed) : target->FLASH_SECTOR_SIZE();
+}
 
-    return destination;
+// Erase a sector aligned range through the stub instead of writing 0xFF.
+CommandStatus EspToolQt::stubEraseRegion(uint32_t memory_offset, uint32_t size) {
+    vector<uint8_t> data_field;
+    appendU32(&data_field, memory_offset);
+    appendU32(&data_field, size);
+    // ~30 s per MB worst case erase time, as in esptool
+    const uint32_t timeout_ms = std::max<uint32_t>(3000, (uint32_t)ceil(30000.0 * size / (1024 * 1024)));
+    return slipCommandStatus(ESP_ERASE_REGION, data_field, 0, timeout_ms, (double)size / (1024 * 1024));
 }
 
 bool EspToolQt::flashData(const uint32_t memory_offset, const std::vector<uint8_t>& data, bool compress) {
+    if (!skip_erased_sectors) {
+        return flashDataRange(memory_offset, data, compress);
+    }
+
+    const vector<FlashExtent> extents = flashExtents(memory_offset, data, target->FLASH_SECTOR_SIZE(), erasedRunThreshold(compress));
+    if (extents.size() == 1 && !extents.front().erased) {
+        return flashDataRange(memory_offset, data, compress);
+    }
+
+    for (const FlashExtent& extent : extents) {
+        if (isCancelled()) {
+            closePort();
+            return false;
+        }
+        if (extent.erased) {
+            const CommandStatus status = stubEraseRegion(memory_offset + extent.start, extent.size);
+            if (status == CommandStatus::NoReply) return false;
+            if (status != CommandStatus::Ok) {
+                // the stub answered, so the link is in step: just send the 0xFF bytes
+                qInfo() << "[WARNING] Stub erase rejected, writing erased sectors";
+                const vector<uint8_t> part(data.begin() + extent.start, data.begin() + extent.start + extent.size);
+                if (!flashDataRange(memory_offset + extent.start, part, compress)) return false;
+                continue;
+            }
+            flash_skipped_bytes_ += extent.size;
+            if (isDiagEnabled()) {
+                qInfo().noquote() << QString("[esp-diag] flashData offset=0x%1 erased=%2 skipped")
+                    .arg(QString::number(memory_offset + extent.start, 16).toUpper())
+                    .arg(extent.size);
+            }
+            continue;
+        }
+        const vector<uint8_t> part(data.begin() + extent.start, data.begin() + extent.start + extent.size);
+        if (!flashDataRange(memory_offset + extent.start, part, compress)) return false;
+    }
+    return true;
+}
+
+// Deflated payload of one flashDataRange() call, from the cache if possible.
+// Safe to call from worker threads.
+EspPayloadCache::PayloadPtr EspToolQt::deflatePayload(uint32_t memory_offset, const std::vector<uint8_t>& data, bool* cached) {
+    EspTrace::Span span = traceSpan("compress", "host");
+    span.arg("size", static_cast<qint64>(data.size()));
+    const QString key = EspPayloadCache::key(data, memory_offset, flash_deflate_level_, target->FLASH_WRITE_SIZE());
+    EspPayloadCache::PayloadPtr payload = EspPayloadCache::shared().find(key, payload_cache_dir);
+    if (cached) *cached = payload != nullptr;
+    if (!payload) payload = EspPayloadCache::shared().insert(key, compress_vector_parallel(data, flash_deflate_level_), payload_cache_dir);
+    return payload;
+}
+
+// Compress ahead what flashData() will send for this block, split the
+// same way, so the write itself finds every payload in the cache.
+void EspToolQt::prepareFlashData(uint32_t memory_offset, const std::vector<uint8_t>& data, bool compress) {
+    if (!compress) return;
+    if (!skip_erased_sectors) {
+        deflatePayload(memory_offset, data, nullptr);
+        return;
+    }
+    const vector<FlashExtent> extents = flashExtents(memory_offset, data, target->FLASH_SECTOR_SIZE(), erasedRunThreshold(compress));
+    if (extents.size() == 1 && !extents.front().erased) {
+        deflatePayload(memory_offset, data, nullptr);
+        return;
+    }
+    for (const FlashExtent& extent : extents) {
+        if (extent.erased) continue;
+        const vector<uint8_t> part(data.begin() + extent.start, data.begin() + extent.start + extent.size);
+        deflatePayload(memory_offset + extent.start, part, nullptr);
+    }
+}
+
+bool EspToolQt::flashDataRange(const uint32_t memory_offset, const std::vector<uint8_t>& data, bool compress) {
     uint32_t max_packet_size = target->FLASH_WRITE_SIZE();
     const bool diag = isDiagEnabled();
     int compress_ms = 0;
@@ -1638,15 +2341,17 @@ bool EspToolQt::flashData(const uint32_t memory_offset, const std::vector<uint8_
 
     // qInfo() << (compress ? "[OK] Compressed flash upload started" : "[OK] Flash upload started");
 
-    // compress data if needed
-    vector<uint8_t> compressed_data;
+    // compress data if needed, reusing payloads compressed for earlier boards
+    EspPayloadCache::PayloadPtr payload;
+    bool payload_cached = false;
     QTime lap = QTime::currentTime();
-    if (compress) compressed_data = compress_vector(data);
+    if (compress) payload = deflatePayload(memory_offset, data, &payload_cached);
     compress_ms = lap.msecsTo(QTime::currentTime());
-    const vector<uint8_t>& upload = compress ? compressed_data : data;
+    const uint8_t* upload = compress ? payload->data() : data.data();
+    const uint32_t upload_size = compress ? payload->size() : data.size();
 
     // calculate number of required packets
-    uint32_t number_of_data_packets = ceil((float)upload.size() / float(max_packet_size));
+    uint32_t number_of_data_packets = ceil((float)upload_size / float(max_packet_size));
     lap = QTime::currentTime();
     if (!flashBegin(data.size(), number_of_data_packets, max_packet_size, memory_offset, compress)) {
         return false;
@@ -1657,91 +2362,111 @@ bool EspToolQt::flashData(const uint32_t memory_offset, const std::vector<uint8_
     vector<uint8_t> tmp_vec;
     tmp_vec.reserve(max_packet_size);
     uint32_t frame_n = 0;
-    for (uint32_t i = 0; i < upload.size(); i++) {
+    for (uint32_t pos = 0; pos < upload_size; pos += max_packet_size) {
         if (isCancelled()) {
             closePort();
             return false;
         }
-        tmp_vec.push_back(upload[i]);
-        if (tmp_vec.size() >= max_packet_size) {
-            lap = QTime::currentTime();
-            if (!flashDataOneBlock(frame_n, tmp_vec, compress)) {
-                return false;
-            }
-            flash_packets_ms += lap.msecsTo(QTime::currentTime());
-            packet_count++;
-            frame_n++;
-            tmp_vec.clear();
-        }
-    }
-    if (tmp_vec.size() != 0) {
+        tmp_vec.assign(upload + pos, upload + std::min(upload_size, pos + max_packet_size));
         lap = QTime::currentTime();
         if (!flashDataOneBlock(frame_n, tmp_vec, compress)) {
             return false;
         }
         flash_packets_ms += lap.msecsTo(QTime::currentTime());
         packet_count++;
+        frame_n++;
     }
     
     // Stub only writes each block to flash after 'ack'ing the receive,
     // so do a final dummy operation which will not be 'ack'ed
     // until the last block has actually been written out to flash
     lap = QTime::currentTime();
-    read_reg(target->CHIP_DETECT_MAGIC_REG_ADDR());
+    readRegTimed(target->CHIP_DETECT_MAGIC_REG_ADDR(), ESP_RTO_FLASH_FINAL_WAIT);
     final_wait_ms = lap.msecsTo(QTime::currentTime());
 
     if (diag) {
         const quint64 logical_size = static_cast<quint64>(data.size());
-        const quint64 wire_size = static_cast<quint64>(upload.size());
+        const quint64 wire_size = static_cast<quint64>(upload_size);
         const double ratio = logical_size == 0 ? 1.0 : static_cast<double>(wire_size) / static_cast<double>(logical_size);
-        qInfo().noquote() << QString("[esp-diag] flashData offset=0x%1 logical=%2 wire=%3 ratio=%4 compressed=%5 max_packet=%6 packets=%7 compress_ms=%8 begin_ms=%9 packet_ms=%10 final_wait_ms=%11 wire_kbit_s=%12")
+        qInfo().noquote() << QString("[esp-diag] flashData offset=0x%1 logical=%2 wire=%3 ratio=%4 compressed=%5 max_packet=%6 packets=%7 compress_ms=%8 begin_ms=%9 packet_ms=%10 final_wait_ms=%11 wire_kbit_s=%12 payload_cache=%13")
             .arg(QString::number(memory_offset, 16).toUpper())
             .arg(logical_size)
             .arg(wire_size)
             .arg(ratio, 0, 'f', 4)
-            .arg(compress ? "yes" : "no")
+            .arg(compress ? QString("level%1").arg(flash_deflate_level_) : QString("no"))
             .arg(max_packet_size)
             .arg(packet_count)
             .arg(compress_ms)
             .arg(flash_begin_ms)
             .arg(flash_packets_ms)
             .arg(final_wait_ms)
-            .arg(kbitPerSecond(wire_size, flash_packets_ms + flash_begin_ms + final_wait_ms), 0, 'f', 2);
+            .arg(kbitPerSecond(wire_size, flash_packets_ms + flash_begin_ms + final_wait_ms), 0, 'f', 2)
+            .arg(!compress ? "off" : (payload_cached ? "hit" : "miss"));
     }
 
     return true;
 }
 
-VerifyBlockResult EspToolQt::verifyFlashBlockMd5Detailed(uint32_t memory_offset, const std::vector<uint8_t>& data) {
+// Ask the stub for the MD5 of a flash range (command 0x13).
+bool EspToolQt::readFlashMd5(uint32_t memory_offset, uint32_t size, std::vector<uint8_t>* md5) {
+    md5->clear();
+    if (!sendFlashMd5Request(memory_offset, size)) return false;
+    return receiveFlashMd5(size, md5);
+}
 
-    // check md5 of written data
+// A pipelined request is queued behind others whose replies may already be
+// waiting in the input, so it must not clear the input like serialWrite().
+bool EspToolQt::sendFlashMd5Request(uint32_t memory_offset, uint32_t size, bool pipelined) {
     vector<uint8_t> md5_read_command;
     appendU32(&md5_read_command, memory_offset);
-    appendU32(&md5_read_command, data.size());
+    appendU32(&md5_read_command, size);
     appendU32(&md5_read_command, 0);
     appendU32(&md5_read_command, 0);
     vector<uint8_t> md5_read_command_frame = slip_encode (0x13, md5_read_command);
-    serialWrite(md5_read_command_frame);
+    if (pipelined) return serialWriteNoWait(md5_read_command_frame);
+    return serialWrite(md5_read_command_frame);
+}
+
+// Reply to sendFlashMd5Request(); size only scales the timeout. A buffered
+// read keeps the frames behind this reply for the next call.
+bool EspToolQt::receiveFlashMd5(uint32_t size, std::vector<uint8_t>* md5, bool buffered) {
+    md5->clear();
+
     // read reply with custom timeout. md5 calculation takes some time
-    vector<uint8_t> reply = serialReadOneFrame((uint32_t)5000 * (uint32_t)ceil((float)data.size()/((float)1024 * 1024)));
+    const double size_mb = (double)size / (1024 * 1024);
+    QElapsedTimer timer;
+    timer.start();
+    const int timeout_ms = replyTimeout(ESP_SPI_FLASH_MD5, (uint32_t)5000 * (uint32_t)ceil(size_mb), ESP_REPLY_WIRE_BYTES + 32, size_mb);
+    vector<uint8_t> reply = buffered ? serialReadOneFrameBuffered(timeout_ms) : serialReadOneFrame(timeout_ms);
+    // a pipelined reply may have waited in the buffer, only learn from a lone one
+    if (!buffered || reply.empty()) replySample(ESP_SPI_FLASH_MD5, timer.elapsed(), ESP_REPLY_WIRE_BYTES + 32, !reply.empty(), size_mb);
     if (isCancelled()) {
         closePort();
-        return VerifyBlockResult::Error;
+        return false;
     }
     SlipReply slip_reply = slip_parse(reply);
 
     // check that we have successfully read md5 from device
     if (slip_reply.valid != true || slip_reply.data.size() < 18) {
         qInfo() << "[ERROR] Failed to get md5 from device";
-        return VerifyBlockResult::Error;
+        return false;
     }
 
     // pop two status bytes from end of frame
     slip_reply.data.pop_back();
     slip_reply.data.pop_back();
 
+    *md5 = slip_reply.data;
+    return true;
+}
+
+VerifyBlockResult EspToolQt::verifyFlashBlockMd5Detailed(uint32_t memory_offset, const std::vector<uint8_t>& data) {
+
     // md5 hash from esp
-    vector<uint8_t> md5_from_esp = slip_reply.data;
+    vector<uint8_t> md5_from_esp;
+    if (!readFlashMd5(memory_offset, data.size(), &md5_from_esp)) {
+        return VerifyBlockResult::Error;
+    }
 
     // md5 hash calculated
     std::vector<uint8_t> copy = data;
@@ -1763,17 +2488,144 @@ bool EspToolQt::verifyFlashBlockMd5(uint32_t memory_offset, const std::vector<ui
     return verifyFlashPr(memory_offset, copy);
 }
 
+// Uploads are split in ~100 blocks (at least two sectors each) so every block
+// maps to one percent of progress and a failed block is cheap to retry.
+uint32_t EspToolQt::uploadBlockSize(uint32_t total_length) {
+    uint32_t blocks_per_percent = total_length / 4096 / 100;
+    if (blocks_per_percent < 2) blocks_per_percent = 2;
+    return blocks_per_percent * 4096;
+}
+
+// Pick raw or deflated upload and the deflate level for one image at the
+// current baud rate. Returns whether the image is sent compressed.
+bool EspToolQt::planCompression(const std::vector<uint8_t>& data, bool compressed) {
+    flash_deflate_level_ = Z_BEST_COMPRESSION;
+    if (!compressed || !adaptive_compression) return compressed;
+
+    const DeflatePlan plan = plan_deflate(data, serial->baudRate());
+    flash_deflate_level_ = plan.level;
+    if (isDiagEnabled()) {
+        qInfo().noquote() << QString("[esp-diag] compression_plan size=%1 baud=%2 entropy=%3 mode=%4 level=%5 est_ratio=%6 est_ms=%7")
+            .arg(static_cast<qulonglong>(data.size()))
+            .arg(serial->baudRate())
+            .arg(plan.entropy, 0, 'f', 3)
+            .arg(plan.compress ? "deflate" : "raw")
+            .arg(plan.level)
+            .arg(plan.ratio, 0, 'f', 4)
+            .arg(plan.estimated_ms, 0, 'f', 1);
+    }
+    return plan.compress;
+}
+
+static bool rangesOverlap(const FlashBadRange& a, const FlashBadRange& b) {
+    return a.offset < b.offset + b.size && b.offset < a.offset + a.size;
+}
+
+// Write one block and check it through the device MD5, in 3 attempts.
+// After the first write only the sectors that still differ are rewritten.
+// Each bad range goes into lastBadRanges once and is marked repaired when
+// a later check no longer finds it bad. written_bad means the caller has
+// already written the block and seen its MD5 differ, so the first attempt
+// goes straight to locating the bad sectors.
+bool EspToolQt::flashBlockVerified(uint32_t memory_offset, const std::vector<uint8_t>& block, bool compressed, bool written_bad) {
+    EspTrace::Span span = traceSpan("flash_block", "flash");
+    span.arg("offset", memory_offset);
+    span.arg("size", static_cast<qint64>(block.size()));
+    vector<FlashBadRange> bad;
+    bool located = false;
+    bool result = false;
+    const size_t recorded = lastBadRanges.size();
+    for(int attempt = 0; attempt < 3; attempt++) {
+        if (isCancelled()) {
+            closePort();
+            return false;
+        }
+        const bool skip_write = attempt == 0 && written_bad;
+        if (attempt != 0) qInfo() << "Retry data block";
+        if (skip_write) {
+            result = true;
+        } else if (located) {
+            result = true;
+            for (const FlashBadRange& range : bad) {
+                const auto begin = block.begin() + (range.offset - memory_offset);
+                result = result && flashData(range.offset, vector<uint8_t>(begin, begin + range.size), compressed);
+            }
+        } else {
+            result = flashData(memory_offset, block, compressed);
+        }
+        if (result == true) {
+            located = locateBadRanges(memory_offset, block, &bad, skip_write);
+            result = located && bad.empty();
+            if (located) {
+                for (size_t i = recorded; i < lastBadRanges.size(); i++) {
+                    FlashBadRange& seen = lastBadRanges[i];
+                    seen.repaired = std::none_of(bad.begin(), bad.end(),
+                        [&seen](const FlashBadRange& range) { return rangesOverlap(seen, range); });
+                }
+                for (const FlashBadRange& range : bad) {
+                    const bool known = std::any_of(lastBadRanges.begin() + recorded, lastBadRanges.end(),
+                        [&range](const FlashBadRange& seen) { return rangesOverlap(seen, range); });
+                    if (!known) lastBadRanges.push_back(range);
+                }
+                if (!bad.empty()) logBadRanges(bad);
+            }
+        }
+        if (result == true) break;
+    }
+    return result;
+}
+
+// Write one block, then check it while the host already compresses the
+// next one and hashes this one on worker threads. An MD5 mismatch goes on
+// to rewrite only the differing sectors; any other failure falls back to
+// the strict write/verify loop of flashBlockVerified().
+bool EspToolQt::flashBlockOverlapped(uint32_t memory_offset, const std::vector<uint8_t>& block, bool compressed, std::function<void()> prepare_next) {
+    EspTrace::Span span = traceSpan("flash_block", "flash");
+    span.arg("offset", memory_offset);
+    span.arg("size", static_cast<qint64>(block.size()));
+    if (isCancelled()) {
+        closePort();
+        return false;
+    }
+    if (flashData(memory_offset, block, compressed)) {
+        std::future<void> next = std::async(std::launch::async, prepare_next);
+        std::future<QByteArray> host_md5 = std::async(std::launch::async, [&block]() {
+            return QCryptographicHash::hash(QByteArray::fromRawData(reinterpret_cast<const char*>(block.data()), static_cast<int>(block.size())),
+                                            QCryptographicHash::Md5);
+        });
+
+        vector<uint8_t> device_md5;
+        const bool hashed = sendFlashMd5Request(memory_offset, block.size()) && receiveFlashMd5(block.size(), &device_md5);
+        next.wait();
+        const QByteArray expected = host_md5.get();
+        if (hashed && device_md5 == vector<uint8_t>(expected.begin(), expected.end())) return true;
+        if (isCancelled()) {
+            closePort();
+            return false;
+        }
+        // written but different: rewrite only the sectors that differ
+        if (hashed) return flashBlockVerified(memory_offset, block, compressed, true);
+    }
+    qInfo() << "Retry data block";
+    return flashBlockVerified(memory_offset, block, compressed);
+}
+
 // #define ESP_TOOL_UPLOAD_DEBUG
 bool EspToolQt::flashUpload(uint32_t memory_offset, std::vector<uint8_t> data, bool compressed) {
     QTime start = QTime::currentTime();
+    EspTrace::Span span = traceSpan("flash_upload", "session");
+    span.arg("offset", memory_offset);
+    span.arg("size", static_cast<qint64>(data.size()));
     bool upload_result = true;
     const bool diag = isDiagEnabled();
     int block_upload_verify_ms = 0;
     quint64 logical_uploaded = 0;
     quint64 block_count = 0;
+    flash_skipped_bytes_ = 0;
+    lastBadRanges.clear();
 
     // check that target is connected
-    if (target == NULL || serial == NULL || !serial->isOpen()) {
+    if (target == NULL || !io()->isOpen()) {
         qInfo() << "[Error] Target is not connected";
         return false;
     }
@@ -1788,17 +2640,26 @@ bool EspToolQt::flashUpload(uint32_t memory_offset, std::vector<uint8_t> data, b
     uint32_t padding_required = (4 - data.size() % 4) % 4;
     if (padding_required) data.resize(data.size() + padding_required, 0xFF);
 
+    // raw or deflate, and at which level
+    compressed = planCompression(data, compressed);
+
     // split data in 100 blocks
     int total_length = data.size();
-    int blocks_per_percent = total_length / 4096 / 100;
-    if (blocks_per_percent < 2) blocks_per_percent = 2;
-    int block_size = blocks_per_percent * 4096;
+    int block_size = uploadBlockSize(total_length);
+
+    // first block is compressed up front, each next one while the previous is verified
+    std::future<void> prepared;
+    if (pipelined_verify) {
+        const vector<uint8_t> first(data.begin(), data.begin() + std::min(block_size, total_length));
+        prepared = std::async(std::launch::async, [this, first, memory_offset, compressed]() {
+            prepareFlashData(memory_offset, first, compressed);
+        });
+    }
 
     #ifdef ESP_TOOL_UPLOAD_DEBUG
     qInfo() << "[DEBUG] Start of Uploading Process";
     qInfo() << "[DEBUG] Upload data block by block...";
     qInfo() << "[DEBUG] total_length =" << total_length;
-    qInfo() << "[DEBUG] blocks_per_percent =" << blocks_per_percent;
     qInfo() << "[DEBUG] block_size =" << block_size;
     #endif // ESP_TOOL_UPLOAD_DEBUG
 
@@ -1825,19 +2686,24 @@ bool EspToolQt::flashUpload(uint32_t memory_offset, std::vector<uint8_t> data, b
         #endif // ESP_TOOL_UPLOAD_DEBUG
 
         // write block in 3 attempts;
-        for(int attempt = 0; attempt < 3; attempt++) {
-            if (isCancelled()) {
-                closePort();
-                return false;
-            }
-            if (attempt != 0) qInfo() << "Retry data block";
-            QTime block_lap = QTime::currentTime();
-            upload_result = flashData(offset, block, compressed);
-            if (upload_result == true) {
-                upload_result = verifyFlashPr(offset, block);
-            }
-            block_upload_verify_ms += block_lap.msecsTo(QTime::currentTime());
-            if (upload_result == true) break;
+        QTime block_lap = QTime::currentTime();
+        if (pipelined_verify) {
+            if (prepared.valid()) prepared.wait();
+            const int next_offset = offset + current_block_size;
+            const int next_size = std::min(block_size, total_length - (next_offset - (int)memory_offset));
+            auto prepare_next = [this, &data, memory_offset, next_offset, next_size, compressed]() {
+                if (next_size <= 0) return;
+                const auto begin = data.begin() + (next_offset - memory_offset);
+                prepareFlashData(next_offset, std::vector<uint8_t>(begin, begin + next_size), compressed);
+            };
+            upload_result = flashBlockOverlapped(offset, block, compressed, prepare_next);
+        } else {
+            upload_result = flashBlockVerified(offset, block, compressed);
+        }
+        block_upload_verify_ms += block_lap.msecsTo(QTime::currentTime());
+        if (isCancelled()) {
+            closePort();
+            return false;
         }
 
         // stop writing process if one block failed
@@ -1851,9 +2717,7 @@ bool EspToolQt::flashUpload(uint32_t memory_offset, std::vector<uint8_t> data, b
         quint64 written = offset - memory_offset + current_block_size;
         logical_uploaded = written;
         block_count++;
-        emit progress_signal(static_cast<int>(written * 100 / total_length));
-        if (progress_bytes_enabled)
-            emit progress_bytes_signal(written, static_cast<quint64>(total_length));
+        reportProgress(written, static_cast<quint64>(total_length));
     }
 
     if (!upload_result) {
@@ -1865,8 +2729,9 @@ bool EspToolQt::flashUpload(uint32_t memory_offset, std::vector<uint8_t> data, b
     if (duration <= 0) duration = 1;
     float speed = ((float)data.size() * 8 / 1000) / ((float)duration / 1000);
     qInfo() << "[OK] Effective speed [kbit/s]:" << speed;
+    if (flash_skipped_bytes_ != 0) qInfo() << "[OK] Erased sectors skipped [bytes]:" << flash_skipped_bytes_;
     if (diag) {
-        qInfo().noquote() << QString("[esp-diag] flashUpload offset=0x%1 logical=%2 blocks=%3 block_size=%4 compressed=%5 total_ms=%6 block_upload_verify_ms=%7 logical_kbit_s=%8")
+        qInfo().noquote() << QString("[esp-diag] flashUpload offset=0x%1 logical=%2 blocks=%3 block_size=%4 compressed=%5 total_ms=%6 block_upload_verify_ms=%7 logical_kbit_s=%8 skipped_erased=%9 pipelined=%10")
             .arg(QString::number(memory_offset, 16).toUpper())
             .arg(logical_uploaded)
             .arg(block_count)
@@ -1874,74 +2739,48 @@ bool EspToolQt::flashUpload(uint32_t memory_offset, std::vector<uint8_t> data, b
             .arg(compressed ? "yes" : "no")
             .arg(duration)
             .arg(block_upload_verify_ms)
-            .arg(kbitPerSecond(logical_uploaded, duration), 0, 'f', 2);
+            .arg(kbitPerSecond(logical_uploaded, duration), 0, 'f', 2)
+            .arg(flash_skipped_bytes_)
+            .arg(pipelined_verify ? "yes" : "no");
+        logRtoDiag();
     }
     return true;
 }
 
-// #define ESP_TOOL_VERIFY_DEBUG
-bool EspToolQt::verifyFlash(uint32_t memory_offset, std::vector<uint8_t> data) {
-    bool verify_result = true;
-    
-    // split data in 100 blocks
-    int total_length = data.size();
-    int blocks_per_percent = total_length / 4096 / 100;
-    if (blocks_per_percent < 2) blocks_per_percent = 2;
-    int block_size = blocks_per_percent * 4096;
-
-    #ifdef ESP_TOOL_VERIFY_DEBUG
-    qInfo() << "[DEBUG] Start of Verification Process";
-    qInfo() << "[DEBUG] Verifing data block by block...";
-    qInfo() << "[DEBUG] total_length =" << total_length;
-    qInfo() << "[DEBUG] blocks_per_percent =" << blocks_per_percent;
-    qInfo() << "[DEBUG] block_size =" << block_size;
-    #endif // ESP_TOOL_VERIFY_DEBUG
-
-    for(int offset = memory_offset; offset < memory_offset + total_length; offset += block_size) {
-        if (isCancelled()) {
-            closePort();
-            return false;
-        }
-        // amount of data left to verify
-        int data_left = total_length - (offset - memory_offset);
-        
-        // size of current block
-        int current_block_size = (data_left >= block_size) ? block_size : data_left;
-
-        // prepare block for verification 
-        std::vector<uint8_t> block;
-        block.insert(block.end(), data.begin() + (offset - memory_offset), data.begin() + (offset - memory_offset) + current_block_size);
-
-        #ifdef ESP_TOOL_VERIFY_DEBUG
-        qInfo() << "[DEBUG] Verifying block with offset [bytes]:" << offset;
-        qInfo() << "[DEBUG] Data left to verify [bytes]:" << data_left;
-        qInfo() << "[DEBUG] Current Block Size [bytes]:" << block.size();
-        #endif // ESP_TOOL_VERIFY_DEBUG
-
-        // verify block in 3 attempts;
-        for(int attempt = 0; attempt < 3; attempt++) {
-            if (isCancelled()) {
-                closePort();
-                return false;
-            }
-            if (attempt != 0) qInfo() << "Retry to verify data block";
-            verify_result = verifyFlashPr(offset, block);
-            if (verify_result == true) break;
-        }
-
-        // stop verification process if one block failed
-        if (verify_result == false) {
-            qInfo().noquote() << QString("Verification failed at memory range [0x%1-0x%2]")
-                .arg(QString::number(offset, 16).toUpper()).arg(QString::number(offset + current_block_size, 16).toUpper());
-            break;
-        }
+#ifdef KT_SELFTEST
+#include "kt_selftest/kt_selftest.h"
+
+KT_TEST(esp_flash_extents_split_at_sectors,
+        "erased runs are whole sectors; partial sectors at either end stay data") {
+    // half a sector of data, two erased sectors, one data sector, half an erased sector
+    std::vector<uint8_t> data(0x4000, 0xFF);
+    std::fill(data.begin(), data.begin() + 0x800, 0x00);
+    std::fill(data.begin() + 0x2800, data.begin() + 0x3800, 0x00);
+    const std::vector<FlashExtent> extents = flashExtents(0x10800, data, 0x1000, 0x1000);
+    KT_ASSERT_EQ(extents.size(), static_cast<size_t>(3));
+    KT_ASSERT(!extents[0].erased);
+    KT_ASSERT_EQ(extents[0].size, 0x800u);
+    KT_ASSERT(extents[1].erased);
+    KT_ASSERT_EQ(extents[1].start, 0x800u);
+    KT_ASSERT_EQ(extents[1].size, 0x2000u);
+    KT_ASSERT(!extents[2].erased);
+    KT_ASSERT_EQ(extents[2].start, 0x2800u);
+    KT_ASSERT_EQ(extents[2].size, 0x1800u);
+}
 
-        // update progress bar
-        quint64 verified = offset - memory_offset + current_block_size;
-        emit progress_signal(static_cast<int>(verified * 100 / total_length));
-        if (progress_bytes_enabled)
-            emit progress_bytes_signal(verified, static_cast<quint64>(total_length));
-    }
-    
-    return verify_result;
+KT_TEST(esp_flash_extents_keep_short_erased_runs,
+        "erased runs below the minimum merge into the data around them") {
+    std::vector<uint8_t> data(0x4000, 0xFF);
+    std::fill(data.begin(), data.begin() + 0x800, 0x00);
+    std::fill(data.begin() + 0x2800, data.begin() + 0x3800, 0x00);
+    const std::vector<FlashExtent> extents = flashExtents(0x10800, data, 0x1000, 0x4000);
+    KT_ASSERT_EQ(extents.size(), static_cast<size_t>(1));
+    KT_ASSERT(!extents[0].erased);
+    KT_ASSERT_EQ(extents[0].size, 0x4000u);
+
+    const std::vector<FlashExtent> erased = flashExtents(0x20000, std::vector<uint8_t>(0x3000, 0xFF), 0x1000, 0x1000);
+    KT_ASSERT_EQ(erased.size(), static_cast<size_t>(1));
+    KT_ASSERT(erased[0].erased);
 }
+
+#endif // KT_SELFTEST
@@ -0,0 +1,99 @@
+/**
+ ******************************************************************************
+ * @file           : src/session.cpp
+ * @brief          : Implements the asynchronous EspToolQt session.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ */
+
+#include "session.h"
+
+#include <QMetaObject>
+
+EspSession::EspSession()
+{
+    tool_ = new EspToolQt();
+    tool_->moveToThread(&thread_);
+    QObject::connect(&thread_, &QThread::finished, tool_, &QObject::deleteLater);
+    thread_.setObjectName(QStringLiteral("EspSession"));
+    thread_.start();
+}
+
+EspSession::~EspSession()
+{
+    cancel();
+    // block until the worker has closed the port; a queued close could
+    // still be pending when the event loop quits
+    QMetaObject::invokeMethod(tool_, [this]() { tool_->closePort(); }, Qt::BlockingQueuedConnection);
+    thread_.quit();
+    thread_.wait();
+}
+
+void EspSession::post(std::function<void()> job)
+{
+    QMetaObject::invokeMethod(tool_, std::move(job), Qt::QueuedConnection);
+}
+
+// Runs on the worker thread. The cancel flag is cleared first and the
+// generation checked after, so a cancel() racing with the start of a job
+// is never lost.
+bool EspSession::startJob(quint64 generation)
+{
+    tool_->clearCancel();
+    return generation == cancel_generation_.load();
+}
+
+void EspSession::cancel()
+{
+    cancel_generation_++;
+    tool_->requestCancel();
+}
+
+std::future<bool> EspSession::chain(std::vector<Step> steps)
+{
+    return run([steps](EspToolQt &tool) {
+        for (const Step &step : steps) {
+            if (tool.isCancelled() || !step(tool)) return false;
+        }
+        return true;
+    });
+}
+
+std::future<bool> EspSession::connect(QString port, uint32_t baud)
+{
+    return run([port, baud](EspToolQt &tool) { return tool.autoConnect(port, baud); });
+}
+
+std::future<std::vector<uint8_t>> EspSession::readFlash(uint32_t memory_offset, uint32_t size)
+{
+    return run([memory_offset, size](EspToolQt &tool) { return tool.readFlash(memory_offset, size); });
+}
+
+std::future<bool> EspSession::flashUpload(uint32_t memory_offset, std::vector<uint8_t> data, bool compressed)
+{
+    return run([memory_offset, data, compressed](EspToolQt &tool) { return tool.flashUpload(memory_offset, data, compressed); });
+}
+
+std::future<bool> EspSession::verifyFlash(uint32_t memory_offset, std::vector<uint8_t> data)
+{
+    return run([memory_offset, data](EspToolQt &tool) { return tool.verifyFlash(memory_offset, data); });
+}
+
+std::future<bool> EspSession::resetFromBoot()
+{
+    return run([](EspToolQt &tool) {
+        tool.resetFromBoot();
+        return true;
+    });
+}
+
+std::future<std::vector<EspBatchResult>> EspSession::runBatch(EspCommandBatch batch)
+{
+    return run([batch](EspToolQt &tool) { return tool.runBatch(batch); });
+}
@@ -0,0 +1,104 @@
+/**
+ ******************************************************************************
+ * @file           : src/session.h
+ * @brief          : Declares the asynchronous EspToolQt session.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ * @details
+ *
+ * EspSession owns an EspToolQt that lives on a worker thread. Every call
+ * queues a job on that thread and returns a std::future right away; jobs
+ * run one after another in submission order. Progress signals of tool()
+ * reach UI slots through queued connections as usual.
+ *
+ * cancel() stops the running job through EspToolQt::requestCancel() and
+ * makes every job queued before it finish at once with an empty result.
+ * A cancelled job closes the port on its way out, so jobs submitted after
+ * cancel() run normally but must connect again first. An exception thrown
+ * by a job reaches the caller through its future.
+ *
+ * The destructor cancels, closes the port on the worker thread and joins
+ * it; do not destroy a session from inside one of its own jobs.
+ *
+ * Usage Example:
+ * ```cpp
+ * EspSession session;
+ * std::future<bool> done = session.chain({
+ *     [](EspToolQt& tool) { return tool.autoConnect("COM5", 921600); },
+ *     [=](EspToolQt& tool) { return tool.flashUpload(0x10000, firmware); },
+ *     [=](EspToolQt& tool) { return tool.verifyFlash(0x10000, firmware); },
+ *     [](EspToolQt& tool) { tool.resetFromBoot(); return true; },
+ * });
+ * ```
+ *
+ ******************************************************************************
+ */
+
+#ifndef ESP_SESSION_H
+#define ESP_SESSION_H
+
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include <QThread>
+
+#include "../esptoolqt.h"
+
+class EspSession
+{
+public:
+    using Step = std::function<bool(EspToolQt&)>;
+
+    EspSession();
+    ~EspSession();
+    EspSession(const EspSession &) = delete;
+    EspSession &operator=(const EspSession &) = delete;
+
+    EspToolQt *tool() const { return tool_; }
+
+    template <typename F>
+    auto run(F job) -> std::future<decltype(job(std::declval<EspToolQt&>()))>;
+    std::future<bool> chain(std::vector<Step> steps);
+    void cancel();
+
+    std::future<bool> connect(QString port, uint32_t baud);
+    std::future<std::vector<uint8_t>> readFlash(uint32_t memory_offset, uint32_t size);
+    std::future<bool> flashUpload(uint32_t memory_offset, std::vector<uint8_t> data, bool compressed = true);
+    std::future<bool> verifyFlash(uint32_t memory_offset, std::vector<uint8_t> data);
+    std::future<bool> resetFromBoot();
+    std::future<std::vector<EspBatchResult>> runBatch(EspCommandBatch batch);
+
+private:
+    void post(std::function<void()> job);
+    bool startJob(quint64 generation);
+
+    QThread thread_;
+    EspToolQt *tool_ = nullptr;
+    std::atomic<quint64> cancel_generation_{0};
+};
+
+template <typename F>
+auto EspSession::run(F job) -> std::future<decltype(job(std::declval<EspToolQt&>()))>
+{
+    using Result = decltype(job(std::declval<EspToolQt&>()));
+    const quint64 generation = cancel_generation_.load();
+    // packaged_task covers void jobs and hands exceptions to the future
+    auto task = std::make_shared<std::packaged_task<Result()>>([this, generation, job]() mutable -> Result {
+        if (!startJob(generation)) return Result();
+        return job(*tool_);
+    });
+    std::future<Result> future = task->get_future();
+    post([task]() { (*task)(); });
+    return future;
+}
+
+#endif // ESP_SESSION_H
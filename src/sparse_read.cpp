@@ -0,0 +1,329 @@
+/**
+ ******************************************************************************
+ * @file           : src/sparse_read.cpp
+ * @brief          : Implements sparse and cached flash reads.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ */
+
+#include "../esptoolqt.h"
+#include "sector_cache.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+using std::vector;
+
+// MD5 of `size` bytes of erased flash (0xFF), cached per size
+const std::vector<uint8_t>& EspToolQt::erasedMd5(uint32_t size) {
+    static std::mutex cache_mutex;
+    static std::map<uint32_t, vector<uint8_t>> cache;
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto cached = cache.find(size);
+    if (cached != cache.end()) return cached->second;
+
+    const QByteArray erased_sector(4096, static_cast<char>(0xFF));
+    QCryptographicHash hash_calc(QCryptographicHash::Md5);
+    for (uint32_t done = 0; done < size; done += erased_sector.size()) {
+        const uint32_t n = std::min<uint32_t>(erased_sector.size(), size - done);
+        hash_calc.addData(QByteArrayView(erased_sector.constData(), n));
+    }
+    const QByteArray hash_qb = hash_calc.result();
+    vector<uint8_t> hash(reinterpret_cast<const uint8_t*>(hash_qb.constData()),
+                         reinterpret_cast<const uint8_t*>(hash_qb.constData()) + hash_qb.size());
+    return cache.emplace(size, hash).first->second;
+}
+
+// Read flash without streaming erased sectors over the wire.
+//
+// Large regions are first classified with the device-side MD5 (0x13): a
+// region whose hash equals the hash of the same number of 0xFF bytes is
+// erased and filled in locally. A region with data is halved (on sector
+// boundaries) and both halves are hashed; every half with data is split
+// further, down to single sectors. Only when an MD5 round trip takes longer
+// than sending the half over the wire at the current baud is a region with
+// data in both halves read as a whole. The data ranges are merged into as
+// few fast reads as possible.
+// The stitched image is checked against one MD5 of the whole range at the end.
+std::vector<uint8_t> EspToolQt::readFlashSparse(uint32_t offset, uint32_t size, uint32_t region_size) {
+    QElapsedTimer timer;
+    timer.start();
+    vector<uint8_t> zero;
+
+    // check that target is connected
+    if (target == NULL || !io()->isOpen()) {
+        qInfo() << "[Error] Target is not connected";
+        return zero;
+    }
+
+    struct Range { uint32_t start; uint32_t size; bool has_data = false; };
+    const uint32_t sector_size = target->FLASH_SECTOR_SIZE();
+    if (region_size < sector_size) region_size = sector_size;
+    region_size -= region_size % sector_size;
+
+    vector<uint8_t> image(size, 0xFF);
+    vector<Range> data_ranges;
+    quint64 done = 0;
+    quint64 md5_queries = 0;
+    quint64 erased_bytes = 0;
+
+    readProgress(0, size);
+
+    // classify, depth first so data ranges come out in address order
+    vector<Range> work;
+    for (uint32_t start = size; start > 0;) {
+        const uint32_t region_start = (start - 1) / region_size * region_size;
+        work.push_back({region_start, start - region_start});
+        start = region_start;
+    }
+    auto add_data = [&data_ranges](const Range& range) {
+        if (!data_ranges.empty() && data_ranges.back().start + data_ranges.back().size == range.start) {
+            data_ranges.back().size += range.size;
+        } else {
+            data_ranges.push_back(range);
+        }
+    };
+    qint64 md5_ms = 0;      // round trip of the last hash
+    auto is_erased = [&](const Range& range, bool* erased) -> bool {
+        vector<uint8_t> md5_from_esp;
+        QElapsedTimer md5_timer;
+        md5_timer.start();
+        if (!readFlashMd5(offset + range.start, range.size, &md5_from_esp)) return false;
+        md5_ms = md5_timer.elapsed();
+        md5_queries++;
+        *erased = md5_from_esp == erasedMd5(range.size);
+        return true;
+    };
+    auto skip = [&](const Range& range) {
+        erased_bytes += range.size;
+        done += range.size;
+        readProgress(done, size);
+    };
+    while (!work.empty()) {
+        if (isCancelled()) {
+            closePort();
+            return zero;
+        }
+        const Range region = work.back();
+        work.pop_back();
+
+        if (!region.has_data) {
+            bool erased = false;
+            if (!is_erased(region, &erased)) return zero;
+            if (erased) {
+                skip(region);
+                continue;
+            }
+        }
+        if (region.size <= sector_size) {
+            add_data(region);
+            continue;
+        }
+
+        uint32_t half = (region.size / 2 + sector_size - 1) / sector_size * sector_size;
+        if (half >= region.size) half = sector_size;
+        const Range low = {region.start, half};
+        const Range high = {region.start + half, region.size - half};
+        bool low_erased = false;
+        bool high_erased = false;
+        if (!is_erased(low, &low_erased)) return zero;
+        qint64 round_trip_ms = md5_ms;
+        if (!is_erased(high, &high_erased)) return zero;
+        round_trip_ms = std::max(round_trip_ms, md5_ms);
+
+        // both halves used: keep splitting unless hashing costs more than
+        // just sending the half
+        if (!low_erased && !high_erased
+            && round_trip_ms > EspRtoEstimator::wireMs(high.size, static_cast<uint32_t>(serial->baudRate()))) {
+            add_data(region);
+            continue;
+        }
+        if (high_erased) {
+            skip(high);
+        } else {
+            work.push_back({high.start, high.size, true});
+        }
+        if (low_erased) {
+            skip(low);
+        } else {
+            work.push_back({low.start, low.size, true});
+        }
+    }
+
+    // transfer only the sectors with data
+    for (const Range& range : data_ranges) {
+        read_progress_base_ = done;
+        read_progress_total_ = size;
+        vector<uint8_t> data = readFlashFast(offset + range.start, range.size);
+        read_progress_base_ = 0;
+        read_progress_total_ = 0;
+        if (data.size() != range.size) return zero;
+        std::copy(data.begin(), data.end(), image.begin() + range.start);
+        done += range.size;
+    }
+
+    vector<uint8_t> md5_from_esp;
+    if (!readFlashMd5(offset, size, &md5_from_esp)) return zero;
+    if (md5_from_esp != calculate_md5_hash(image)) {
+        qInfo() << "[ERROR] Sparse read MD5 Check Failed";
+        return zero;
+    }
+
+    readProgress(size, size);
+    qInfo() << "[OK] Sparse read done, erased bytes skipped:" << erased_bytes
+            << "of" << size;
+    if (isDiagEnabled()) {
+        qInfo().noquote() << QString("[esp-diag] sparse_read offset=0x%1 size=%2 region=%3 md5_queries=%4 data_ranges=%5 data_bytes=%6 erased_bytes=%7 total_ms=%8")
+            .arg(QString::number(offset, 16).toUpper())
+            .arg(size)
+            .arg(region_size)
+            .arg(md5_queries)
+            .arg(static_cast<qulonglong>(data_ranges.size()))
+            .arg(static_cast<qulonglong>(size - erased_bytes))
+            .arg(erased_bytes)
+            .arg(timer.elapsed());
+    }
+    return image;
+}
+
+// Read flash through the opt-in sector cache in flash_cache_dir.
+//
+// For every region whose sectors were all seen on the last read, the region
+// is rebuilt from the cache and confirmed with one device MD5. Regions that
+// changed are checked sector by sector: a sector whose device MD5 is already
+// in the content store is taken from disk, everything else is read from the
+// chip and added to the cache. Regions never seen before are read directly.
+std::vector<uint8_t> EspToolQt::readFlashCached(uint32_t offset, uint32_t size) {
+    const uint32_t REGION_SECTORS = 16;
+    QElapsedTimer timer;
+    timer.start();
+    vector<uint8_t> zero;
+
+    // check that target is connected
+    if (target == NULL || !io()->isOpen()) {
+        qInfo() << "[Error] Target is not connected";
+        return zero;
+    }
+
+    QString mac;
+    uint32_t flash_id = 0;
+    if (flash_cache_dir.isEmpty() || !flashDeviceIdentity(&mac, &flash_id)) {
+        return readFlashFast(offset, size);
+    }
+
+    EspSectorCache cache(flash_cache_dir, EspSectorCache::deviceKey(mac, flash_id));
+    cache.loadMap();
+
+    struct Range { uint32_t start; uint32_t size; };
+    const uint32_t sector_size = target->FLASH_SECTOR_SIZE();
+    const uint32_t region_size = sector_size * REGION_SECTORS;
+
+    vector<uint8_t> image(size, 0xFF);
+    vector<Range> to_read;
+    quint64 done = 0;
+    quint64 md5_queries = 0;
+    quint64 cached_bytes = 0;
+
+    auto queue_read = [&](uint32_t start, uint32_t length) {
+        if (!to_read.empty() && to_read.back().start + to_read.back().size == start) {
+            to_read.back().size += length;
+        } else {
+            to_read.push_back({start, length});
+        }
+    };
+
+    readProgress(0, size);
+    for (uint32_t region = 0; region < size; region += region_size) {
+        if (isCancelled()) {
+            closePort();
+            return zero;
+        }
+        const uint32_t region_len = std::min(region_size, size - region);
+
+        // try the whole region from the last known layout
+        bool known = true;
+        vector<uint8_t> region_data;
+        region_data.reserve(region_len);
+        for (uint32_t sector = region; sector < region + region_len && known; sector += sector_size) {
+            const uint32_t sector_len = std::min(sector_size, region + region_len - sector);
+            vector<uint8_t> sector_data;
+            known = cache.lookup(cache.mapped(offset + sector), &sector_data) && sector_data.size() == sector_len;
+            appendVec(region_data, sector_data);
+        }
+        if (!known) {
+            // nothing to compare against, hashing would only add round trips
+            queue_read(region, region_len);
+            continue;
+        }
+
+        vector<uint8_t> md5_from_esp;
+        if (!readFlashMd5(offset + region, region_len, &md5_from_esp)) return zero;
+        md5_queries++;
+        if (md5_from_esp == calculate_md5_hash(region_data)) {
+            std::copy(region_data.begin(), region_data.end(), image.begin() + region);
+            cached_bytes += region_len;
+            done += region_len;
+            readProgress(done, size);
+            continue;
+        }
+
+        // region changed: look sectors up by their current content hash
+        for (uint32_t sector = region; sector < region + region_len; sector += sector_size) {
+            const uint32_t sector_len = std::min(sector_size, region + region_len - sector);
+            if (!readFlashMd5(offset + sector, sector_len, &md5_from_esp)) return zero;
+            md5_queries++;
+            const QByteArray md5(reinterpret_cast<const char*>(md5_from_esp.data()), static_cast<int>(md5_from_esp.size()));
+            vector<uint8_t> sector_data;
+            if (cache.lookup(md5, &sector_data) && sector_data.size() == sector_len) {
+                std::copy(sector_data.begin(), sector_data.end(), image.begin() + sector);
+                cache.setMapped(offset + sector, md5);
+                cached_bytes += sector_len;
+                done += sector_len;
+            } else {
+                queue_read(sector, sector_len);
+            }
+        }
+        readProgress(done, size);
+    }
+
+    // pull what the cache could not provide and remember it
+    for (const Range& range : to_read) {
+        read_progress_base_ = done;
+        read_progress_total_ = size;
+        vector<uint8_t> data = readFlashFast(offset + range.start, range.size);
+        read_progress_base_ = 0;
+        read_progress_total_ = 0;
+        if (data.size() != range.size) return zero;
+        std::copy(data.begin(), data.end(), image.begin() + range.start);
+        for (uint32_t sector = 0; sector < range.size; sector += sector_size) {
+            const uint32_t sector_len = std::min(sector_size, range.size - sector);
+            cache.setMapped(offset + range.start + sector, cache.store(data.data() + sector, sector_len));
+        }
+        done += range.size;
+    }
+    cache.saveMap();
+
+    readProgress(size, size);
+    qInfo() << "[OK] Cached read done, bytes from cache:" << cached_bytes << "of" << size;
+    if (isDiagEnabled()) {
+        qInfo().noquote() << QString("[esp-diag] cached_read offset=0x%1 size=%2 md5_queries=%3 cached_bytes=%4 read_ranges=%5 total_ms=%6")
+            .arg(QString::number(offset, 16).toUpper())
+            .arg(size)
+            .arg(md5_queries)
+            .arg(cached_bytes)
+            .arg(static_cast<qulonglong>(to_read.size()))
+            .arg(timer.elapsed());
+    }
+    return image;
+}
@@ -80,7 +80,7 @@ uint32_t EspToolQt::runSpiFlashCommand(uint32_t command, std::vector<uint8_t> da
 
     write_reg(target->SPI_USR2_REG(), (7 << SPI_USR2_COMMAND_LEN_SHIFT) | command);
 
-    if (addr && addr_len) write_reg(target->SPI_ADDR_REG(), addr);
+    if (addr_len) write_reg(target->SPI_ADDR_REG(), addr);
 
     if (data_bits == 0) {
         write_reg(target->SPI_W0_REG(), 0);  // clear data register before we read it
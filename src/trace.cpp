@@ -0,0 +1,178 @@
+/**
+ ******************************************************************************
+ * @file           : src/trace.cpp
+ * @brief          : Implements the trace-event recorder for protocol phases.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ */
+
+#include "trace.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QSaveFile>
+
+namespace {
+
+void appendJsonString(QByteArray *out, const QByteArray &value)
+{
+    out->append('"');
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            out->append('\\');
+            out->append(c);
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            static const char hex[] = "0123456789abcdef";
+            out->append("\\u00");
+            out->append(hex[(c >> 4) & 0xF]);
+            out->append(hex[c & 0xF]);
+        } else {
+            out->append(c);
+        }
+    }
+    out->append('"');
+}
+
+}
+
+EspTrace::Span::Span(EspTrace *trace, int track, const char *name, const char *category)
+    : trace_(trace), track_(track), name_(name), category_(category)
+{
+    if (trace_) start_us_ = trace_->nowUs();
+}
+
+EspTrace::Span::Span(Span &&other) noexcept
+    : trace_(other.trace_), track_(other.track_), name_(other.name_), category_(other.category_),
+      start_us_(other.start_us_), args_(std::move(other.args_))
+{
+    other.trace_ = nullptr;
+}
+
+void EspTrace::Span::end()
+{
+    if (!trace_) return;
+    trace_->complete(track_, name_, category_, start_us_, trace_->nowUs() - start_us_, std::move(args_));
+    trace_ = nullptr;
+}
+
+EspTrace::EspTrace() : start_(std::chrono::steady_clock::now())
+{
+}
+
+int EspTrace::addTrack(const QString &name)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    tracks_.push_back(name);
+    return static_cast<int>(tracks_.size());
+}
+
+qint64 EspTrace::nowUs() const
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_).count();
+}
+
+void EspTrace::complete(int track, const char *name, const char *category, qint64 start_us, qint64 duration_us, Args args)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_.push_back(Event{track, name, category, start_us, duration_us, std::move(args)});
+}
+
+size_t EspTrace::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return events_.size();
+}
+
+void EspTrace::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_.clear();
+}
+
+// Chrome trace-event format: "X" complete events, plus "M" metadata events
+// naming each track.
+QByteArray EspTrace::toJson() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+    QByteArray json;
+    json.reserve(static_cast<int>(events_.size()) * 128 + 256);
+    json.append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (size_t i = 0; i < tracks_.size(); i++) {
+        if (!first) json.append(",\n");
+        first = false;
+        json.append("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"tid\":" + QByteArray::number(static_cast<int>(i + 1)) + ",\"args\":{\"name\":");
+        appendJsonString(&json, tracks_[i].toUtf8());
+        json.append("}}");
+    }
+    for (const Event &event : events_) {
+        if (!first) json.append(",\n");
+        first = false;
+        json.append("{\"name\":");
+        appendJsonString(&json, QByteArray(event.name));
+        json.append(",\"cat\":");
+        appendJsonString(&json, QByteArray(event.category));
+        json.append(",\"ph\":\"X\",\"ts\":" + QByteArray::number(event.start_us)
+                    + ",\"dur\":" + QByteArray::number(event.duration_us)
+                    + ",\"pid\":" + pid + ",\"tid\":" + QByteArray::number(event.track));
+        if (!event.args.empty()) {
+            json.append(",\"args\":{");
+            for (size_t i = 0; i < event.args.size(); i++) {
+                if (i != 0) json.append(',');
+                appendJsonString(&json, QByteArray(event.args[i].first));
+                json.append(':');
+                json.append(QByteArray::number(event.args[i].second));
+            }
+            json.append('}');
+        }
+        json.append('}');
+    }
+    json.append("\n]}\n");
+    return json;
+}
+
+bool EspTrace::save(const QString &path) const
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qInfo() << "[ERROR] Can't write trace file:" << path;
+        return false;
+    }
+    file.write(toJson());
+    if (!file.commit()) {
+        qInfo() << "[ERROR] Can't write trace file:" << path;
+        return false;
+    }
+    qInfo() << "[OK] Trace saved:" << path;
+    return true;
+}
+
+#ifdef KT_SELFTEST
+#include "kt_selftest/kt_selftest.h"
+
+KT_TEST(esp_trace_exports_complete_events,
+        "spans become X events on their session track, inert spans record nothing") {
+    EspTrace trace;
+    const int track = trace.addTrack(QStringLiteral("slot \"1\""));
+    {
+        EspTrace::Span span(&trace, track, "flash_block", "flash");
+        span.arg("offset", 0x1000);
+        EspTrace::Span inert;
+        inert.arg("ignored", 1);
+    }
+    KT_ASSERT_EQ(trace.size(), static_cast<size_t>(1));
+
+    const QByteArray json = trace.toJson();
+    KT_ASSERT(json.contains("\"ph\":\"X\""));
+    KT_ASSERT(json.contains("\"args\":{\"offset\":4096}"));
+    KT_ASSERT(json.contains("\"name\":\"slot \\\"1\\\"\""));
+}
+
+#endif // KT_SELFTEST
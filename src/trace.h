@@ -0,0 +1,100 @@
+/**
+ ******************************************************************************
+ * @file           : src/trace.h
+ * @brief          : Declares the trace-event recorder for protocol phases.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ * @details
+ *
+ * EspTrace collects timed spans (connect, reset, sync, stub upload, baud
+ * change, commands, flash blocks, verify regions) and writes them as Chrome
+ * trace-event JSON, which chrome://tracing and ui.perfetto.dev open
+ * directly. One trace can be shared by many EspToolQt instances; each gets
+ * its own track, so a whole fixture shows up as parallel rows on one clock.
+ *
+ * Usage Example:
+ * ```cpp
+ * EspTrace trace;
+ * tool_a.setTrace(&trace, "slot 1");
+ * tool_b.setTrace(&trace, "slot 2");
+ * ...
+ * trace.save("fixture.trace.json");
+ * ```
+ *
+ ******************************************************************************
+ */
+
+#ifndef ESP_TRACE_H
+#define ESP_TRACE_H
+
+#include <chrono>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <QByteArray>
+#include <QString>
+
+class EspTrace
+{
+public:
+    using Args = std::vector<std::pair<const char *, qint64>>;
+
+    // Records one complete event when it ends or goes out of scope. A
+    // default constructed span is inert, so tracing costs nothing when off.
+    // Names and keys must be string literals.
+    class Span {
+    public:
+        Span() = default;
+        Span(EspTrace *trace, int track, const char *name, const char *category);
+        Span(Span &&other) noexcept;
+        Span(const Span &) = delete;
+        Span &operator=(const Span &) = delete;
+        ~Span() { end(); }
+
+        void arg(const char *key, qint64 value) { if (trace_) args_.emplace_back(key, value); }
+        void end();
+
+    private:
+        EspTrace *trace_ = nullptr;
+        int track_ = 0;
+        const char *name_ = nullptr;
+        const char *category_ = nullptr;
+        qint64 start_us_ = 0;
+        Args args_;
+    };
+
+    EspTrace();
+
+    int addTrack(const QString &name);
+    qint64 nowUs() const;
+    void complete(int track, const char *name, const char *category, qint64 start_us, qint64 duration_us, Args args = Args());
+    size_t size() const;
+    void clear();
+
+    QByteArray toJson() const;
+    bool save(const QString &path) const;
+
+private:
+    struct Event {
+        int track;
+        const char *name;
+        const char *category;
+        qint64 start_us;
+        qint64 duration_us;
+        Args args;
+    };
+
+    mutable std::mutex mutex_;
+    std::vector<Event> events_;
+    std::vector<QString> tracks_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+#endif // ESP_TRACE_H
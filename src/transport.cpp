@@ -0,0 +1,545 @@
+/**
+ ******************************************************************************
+ * @file           : src/transport.cpp
+ * @brief          : Implements the serial, capture, replay and fault transports.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ */
+
+#include "transport.h"
+
+#include <QDebug>
+#include <QSerialPort>
+
+#include <algorithm>
+#include <limits>
+#include <thread>
+
+namespace {
+
+const char kCaptureMagic[] = "ESPCAP1\n";
+const int kCaptureMagicSize = 8;
+const int kCaptureHeaderSize = 13;
+const qint64 kCaptureMergeGapNs = 2000000;
+
+qint64 steadyNowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void appendLe(QByteArray *out, quint64 value, int bytes)
+{
+    for (int i = 0; i < bytes; i++) out->append(static_cast<char>((value >> (8 * i)) & 0xFF));
+}
+
+quint64 readLe(const char *in, int bytes)
+{
+    quint64 value = 0;
+    for (int i = 0; i < bytes; i++) value |= static_cast<quint64>(static_cast<uint8_t>(in[i])) << (8 * i);
+    return value;
+}
+
+}
+
+// --- serial ---
+
+bool EspSerialTransport::isOpen() const
+{
+    return port_ != NULL && port_->isOpen();
+}
+
+bool EspSerialTransport::hasError() const
+{
+    if (port_ == NULL) return true;
+    switch (port_->error()) {
+    case QSerialPort::NoError:
+    case QSerialPort::TimeoutError:
+        return false;
+    default:
+        return true;
+    }
+}
+
+QString EspSerialTransport::errorString() const
+{
+    if (port_ == NULL) return QStringLiteral("Serial port is not initialized");
+    return port_->errorString();
+}
+
+qint64 EspSerialTransport::write(const char *data, qint64 size)
+{
+    return port_->write(data, size);
+}
+
+bool EspSerialTransport::waitForBytesWritten(int timeout_ms)
+{
+    return port_->waitForBytesWritten(timeout_ms);
+}
+
+bool EspSerialTransport::waitForReadyRead(int timeout_ms)
+{
+    return port_->waitForReadyRead(timeout_ms);
+}
+
+QByteArray EspSerialTransport::read(qint64 max_size)
+{
+    return port_->read(max_size);
+}
+
+QByteArray EspSerialTransport::readAll()
+{
+    return port_->readAll();
+}
+
+void EspSerialTransport::clearInput()
+{
+    port_->clear(QSerialPort::Input);
+}
+
+void EspSerialTransport::clear()
+{
+    port_->clear();
+}
+
+// --- capture ---
+
+EspCaptureTransport::~EspCaptureTransport()
+{
+    finish();
+}
+
+bool EspCaptureTransport::open(const QString &path)
+{
+    file_.setFileName(path);
+    if (!file_.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qInfo() << "[ERROR] Can't open capture file:" << path;
+        return false;
+    }
+    file_.write(kCaptureMagic, kCaptureMagicSize);
+    start_ = std::chrono::steady_clock::now();
+    records_ = 0;
+    return true;
+}
+
+void EspCaptureTransport::finish()
+{
+    if (!file_.isOpen()) return;
+    file_.write(pending_);
+    pending_.clear();
+    open_record_ = -1;
+    file_.close();
+}
+
+void EspCaptureTransport::record(Direction direction, const char *data, qint64 size)
+{
+    if (!file_.isOpen() || size <= 0) return;
+    const qint64 timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start_).count();
+    if (open_record_ >= 0 && open_direction_ == direction && timestamp_ns - open_last_ns_ < kCaptureMergeGapNs) {
+        // grow the open record, it keeps its first timestamp
+        char *length_le = pending_.data() + open_record_ + 9;
+        const quint64 length = readLe(length_le, 4) + static_cast<quint64>(size);
+        for (int i = 0; i < 4; i++) length_le[i] = static_cast<char>((length >> (8 * i)) & 0xFF);
+    } else {
+        open_record_ = pending_.size();
+        open_direction_ = direction;
+        pending_.append(static_cast<char>(direction));
+        appendLe(&pending_, static_cast<quint64>(timestamp_ns), 8);
+        appendLe(&pending_, static_cast<quint64>(size), 4);
+        records_++;
+    }
+    pending_.append(data, static_cast<int>(size));
+    open_last_ns_ = timestamp_ns;
+    // buffered so the capture does not add a file write per frame
+    if (pending_.size() >= 64 * 1024) {
+        file_.write(pending_);
+        pending_.clear();
+        open_record_ = -1;
+    }
+}
+
+qint64 EspCaptureTransport::write(const char *data, qint64 size)
+{
+    const qint64 written = inner_->write(data, size);
+    if (written > 0) record(ToTarget, data, written);
+    return written;
+}
+
+QByteArray EspCaptureTransport::read(qint64 max_size)
+{
+    QByteArray data = inner_->read(max_size);
+    record(FromTarget, data.constData(), data.size());
+    return data;
+}
+
+QByteArray EspCaptureTransport::readAll()
+{
+    QByteArray data = inner_->readAll();
+    record(FromTarget, data.constData(), data.size());
+    return data;
+}
+
+// --- replay ---
+
+bool EspReplayTransport::open(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error_ = QStringLiteral("Can't open capture file: %1").arg(path);
+        qInfo() << "[ERROR]" << error_;
+        return false;
+    }
+    return load(file.readAll());
+}
+
+bool EspReplayTransport::load(const QByteArray &capture)
+{
+    records_.clear();
+    record_ = 0;
+    record_pos_ = 0;
+    mismatched_bytes_ = 0;
+    open_ = false;
+    if (capture.size() < kCaptureMagicSize || !capture.startsWith(QByteArray(kCaptureMagic, kCaptureMagicSize))) {
+        error_ = QStringLiteral("Not a capture file");
+        qInfo() << "[ERROR]" << error_;
+        return false;
+    }
+
+    int pos = kCaptureMagicSize;
+    while (pos < capture.size()) {
+        if (capture.size() - pos < kCaptureHeaderSize) break;
+        Record record;
+        record.direction = static_cast<uint8_t>(capture.at(pos));
+        record.timestamp_ns = static_cast<qint64>(readLe(capture.constData() + pos + 1, 8));
+        const quint64 size = readLe(capture.constData() + pos + 9, 4);
+        pos += kCaptureHeaderSize;
+        if (size > static_cast<quint64>(capture.size() - pos)) break;
+        record.data = capture.mid(pos, static_cast<int>(size));
+        pos += static_cast<int>(size);
+        records_.push_back(record);
+    }
+    if (pos != capture.size()) qInfo() << "[WARNING] Capture file is truncated, replaying" << records_.size() << "records";
+
+    anchor_ns_ = steadyNowNs();
+    open_ = true;
+    return true;
+}
+
+qint64 EspReplayTransport::write(const char *data, qint64 size)
+{
+    if (!open_) return -1;
+    for (qint64 i = 0; i < size; i++) {
+        if (atEnd() || records_[record_].direction != EspCaptureTransport::ToTarget) {
+            mismatched_bytes_ += size - i;
+            break;
+        }
+        const Record &record = records_[record_];
+        if (record.data.at(record_pos_) != data[i]) mismatched_bytes_++;
+        if (++record_pos_ >= record.data.size()) {
+            anchor_ns_ = steadyNowNs() - record.timestamp_ns;
+            record_++;
+            record_pos_ = 0;
+        }
+    }
+    return size;
+}
+
+bool EspReplayTransport::rxReady() const
+{
+    if (!open_ || atEnd()) return false;
+    const Record &record = records_[record_];
+    if (record.direction != EspCaptureTransport::FromTarget) return false;
+    return !paced_ || steadyNowNs() - anchor_ns_ >= record.timestamp_ns;
+}
+
+bool EspReplayTransport::waitForReadyRead(int timeout_ms)
+{
+    if (rxReady()) return true;
+    qint64 wait_ns = static_cast<qint64>(timeout_ms) * 1000000;
+    if (paced_ && open_ && !atEnd() && records_[record_].direction == EspCaptureTransport::FromTarget) {
+        wait_ns = std::min(wait_ns, records_[record_].timestamp_ns - (steadyNowNs() - anchor_ns_));
+    }
+    // nothing recorded for this point of the exchange: behave like a quiet line
+    if (wait_ns > 0) std::this_thread::sleep_for(std::chrono::nanoseconds(wait_ns));
+    return rxReady();
+}
+
+QByteArray EspReplayTransport::read(qint64 max_size)
+{
+    QByteArray data;
+    while (data.size() < max_size && rxReady()) {
+        const Record &record = records_[record_];
+        const int take = static_cast<int>(std::min<qint64>(max_size - data.size(), record.data.size() - record_pos_));
+        data.append(record.data.constData() + record_pos_, take);
+        record_pos_ += take;
+        if (record_pos_ >= record.data.size()) {
+            record_++;
+            record_pos_ = 0;
+        }
+    }
+    return data;
+}
+
+QByteArray EspReplayTransport::readAll()
+{
+    return read(std::numeric_limits<int>::max());
+}
+
+// --- fault injection ---
+
+EspFaultTransport::EspFaultTransport(EspTransport *inner, const Faults &faults)
+    : inner_(inner), faults_(faults), random_(faults.seed)
+{
+}
+
+QByteArray EspFaultTransport::corrupt(const char *data, qint64 size)
+{
+    QByteArray out;
+    out.reserve(static_cast<int>(size));
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    for (qint64 i = 0; i < size; i++) {
+        char byte = data[i];
+        if (faults_.drop_rate > 0 && chance(random_) < faults_.drop_rate) {
+            stats_.dropped++;
+            continue;
+        }
+        if (faults_.bit_flip_rate > 0 && chance(random_) < faults_.bit_flip_rate) {
+            byte = static_cast<char>(byte ^ (1 << (random_() % 8)));
+            stats_.flipped++;
+        }
+        out.append(byte);
+    }
+    return out;
+}
+
+// Delivery time of a chunk of size bytes entering a link that is busy until
+// *link_free_ns. Stalls hold back this chunk and everything queued after it.
+qint64 EspFaultTransport::schedule(qint64 *link_free_ns, qint64 size)
+{
+    const qint64 now = steadyNowNs();
+    if (faults_.stall_rate > 0 && std::uniform_real_distribution<double>(0.0, 1.0)(random_) < faults_.stall_rate) {
+        stalled_until_ns_ = std::max(stalled_until_ns_, now) + static_cast<qint64>(faults_.stall_ms) * 1000000;
+        stats_.stalls++;
+    }
+    qint64 start = std::max(now, *link_free_ns);
+    if (faults_.bandwidth_bps != 0) start += size * 8 * 1000000000LL / static_cast<qint64>(faults_.bandwidth_bps);
+    *link_free_ns = start;
+
+    qint64 due = start + static_cast<qint64>(faults_.latency_ms) * 1000000;
+    if (faults_.jitter_ms > 0) due += static_cast<qint64>(random_() % (static_cast<quint64>(faults_.jitter_ms) * 1000000 + 1));
+    return std::max(due, stalled_until_ns_);
+}
+
+// Move due host traffic to the inner transport and collect what arrived.
+void EspFaultTransport::pump()
+{
+    const qint64 now = steadyNowNs();
+    while (!tx_.empty() && tx_.front().due_ns <= now) {
+        inner_->write(tx_.front().data.constData(), tx_.front().data.size());
+        tx_.pop_front();
+    }
+    QByteArray arrived = inner_->readAll();
+    if (arrived.isEmpty()) return;
+    Chunk chunk;
+    chunk.data = corrupt(arrived.constData(), arrived.size());
+    chunk.due_ns = schedule(&rx_free_ns_, arrived.size());
+    // a chunk never overtakes the one before it
+    if (!rx_.empty()) chunk.due_ns = std::max(chunk.due_ns, rx_.back().due_ns);
+    if (!chunk.data.isEmpty()) rx_.push_back(chunk);
+}
+
+bool EspFaultTransport::rxReady() const
+{
+    return !rx_.empty() && rx_.front().due_ns <= steadyNowNs();
+}
+
+qint64 EspFaultTransport::write(const char *data, qint64 size)
+{
+    if (!inner_->isOpen()) return -1;
+    Chunk chunk;
+    chunk.data = faults_.faults_to_target ? corrupt(data, size) : QByteArray(data, static_cast<int>(size));
+    chunk.due_ns = schedule(&tx_free_ns_, size);
+    if (!tx_.empty()) chunk.due_ns = std::max(chunk.due_ns, tx_.back().due_ns);
+    tx_.push_back(chunk);
+    pump();
+    return size;
+}
+
+bool EspFaultTransport::waitForBytesWritten(int timeout_ms)
+{
+    const qint64 deadline = steadyNowNs() + static_cast<qint64>(timeout_ms) * 1000000;
+    pump();
+    while (!tx_.empty()) {
+        const qint64 wait_ns = std::min(tx_.front().due_ns, deadline) - steadyNowNs();
+        if (wait_ns > 0) std::this_thread::sleep_for(std::chrono::nanoseconds(wait_ns));
+        pump();
+        if (steadyNowNs() >= deadline) break;
+    }
+    if (!tx_.empty()) return false;
+    return inner_->waitForBytesWritten(std::max<qint64>(0, (deadline - steadyNowNs()) / 1000000));
+}
+
+bool EspFaultTransport::waitForReadyRead(int timeout_ms)
+{
+    const qint64 deadline = steadyNowNs() + static_cast<qint64>(timeout_ms) * 1000000;
+    pump();
+    while (!rxReady()) {
+        const qint64 now = steadyNowNs();
+        if (now >= deadline) return false;
+        if (!rx_.empty()) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(std::min(rx_.front().due_ns, deadline) - now));
+        } else if (!inner_->waitForReadyRead(static_cast<int>(std::max<qint64>(1, (deadline - now) / 1000000)))
+                   && !inner_->isOpen()) {
+            return false;
+        }
+        pump();
+    }
+    return true;
+}
+
+QByteArray EspFaultTransport::read(qint64 max_size)
+{
+    pump();
+    QByteArray data;
+    while (data.size() < max_size && rxReady()) {
+        Chunk &chunk = rx_.front();
+        const int take = static_cast<int>(std::min<qint64>(max_size - data.size(), chunk.data.size()));
+        data.append(chunk.data.constData(), take);
+        chunk.data.remove(0, take);
+        if (chunk.data.isEmpty()) rx_.pop_front();
+    }
+    return data;
+}
+
+QByteArray EspFaultTransport::readAll()
+{
+    return read(std::numeric_limits<int>::max());
+}
+
+void EspFaultTransport::clearInput()
+{
+    rx_.clear();
+    inner_->clearInput();
+}
+
+void EspFaultTransport::clear()
+{
+    rx_.clear();
+    tx_.clear();
+    inner_->clear();
+}
+
+#ifdef KT_SELFTEST
+#include "kt_selftest/kt_selftest.h"
+
+#include <QDir>
+
+KT_TEST(esp_replay_transport_orders_replies,
+        "replies are held back until the host wrote the request before them") {
+    QByteArray capture(kCaptureMagic, kCaptureMagicSize);
+    auto add = [&capture](uint8_t direction, const QByteArray &data) {
+        capture.append(static_cast<char>(direction));
+        appendLe(&capture, 0, 8);
+        appendLe(&capture, static_cast<quint64>(data.size()), 4);
+        capture.append(data);
+    };
+    add(EspCaptureTransport::ToTarget, QByteArray("\xC0\x00\x0A\xC0", 4));
+    add(EspCaptureTransport::FromTarget, QByteArray("\xC0\x01\x0A", 3));
+    add(EspCaptureTransport::FromTarget, QByteArray("\x00\xC0", 2));
+
+    EspReplayTransport replay;
+    KT_ASSERT(replay.load(capture));
+    KT_ASSERT(!replay.waitForReadyRead(0));
+    KT_ASSERT_EQ(replay.write("\xC0\x00\x0A\xC0", 4), static_cast<qint64>(4));
+    KT_ASSERT(replay.waitForReadyRead(0));
+    KT_ASSERT_EQ(replay.read(4), QByteArray("\xC0\x01\x0A\x00", 4));
+    KT_ASSERT_EQ(replay.readAll(), QByteArray("\xC0", 1));
+    KT_ASSERT(replay.atEnd());
+    KT_ASSERT_EQ(replay.mismatchedBytes(), static_cast<quint64>(0));
+}
+
+namespace {
+
+// loops every write straight back as received data
+class LoopbackTransport : public EspTransport
+{
+public:
+    bool isOpen() const override { return true; }
+    bool hasError() const override { return false; }
+    QString errorString() const override { return QString(); }
+    qint64 write(const char *data, qint64 size) override { buffer_.append(data, static_cast<int>(size)); return size; }
+    bool waitForBytesWritten(int) override { return true; }
+    bool waitForReadyRead(int) override { return !buffer_.isEmpty(); }
+    QByteArray read(qint64 max_size) override { QByteArray out = buffer_.left(static_cast<int>(max_size)); buffer_.remove(0, out.size()); return out; }
+    QByteArray readAll() override { QByteArray out = buffer_; buffer_.clear(); return out; }
+    void clearInput() override { buffer_.clear(); }
+    void clear() override { buffer_.clear(); }
+
+private:
+    QByteArray buffer_;
+};
+
+QByteArray faultLoop(const EspFaultTransport::Faults &faults, const QByteArray &sent)
+{
+    LoopbackTransport loopback;
+    EspFaultTransport link(&loopback, faults);
+    link.write(sent.constData(), sent.size());
+    link.waitForBytesWritten(100);
+    QByteArray received;
+    while (link.waitForReadyRead(50)) received.append(link.readAll());
+    return received;
+}
+
+}
+
+KT_TEST(esp_fault_transport_is_seeded,
+        "the same seed corrupts the same bytes, latency holds data back") {
+    const QByteArray sent(4096, '\x55');
+    EspFaultTransport::Faults faults;
+    faults.bit_flip_rate = 0.01;
+    faults.drop_rate = 0.01;
+    faults.seed = 42;
+    const QByteArray first = faultLoop(faults, sent);
+    KT_ASSERT(first != sent);
+    KT_ASSERT_EQ(first, faultLoop(faults, sent));
+
+    LoopbackTransport loopback;
+    EspFaultTransport::Faults slow;
+    slow.latency_ms = 30;
+    EspFaultTransport link(&loopback, slow);
+    link.write("\xC0\xC0", 2);
+    KT_ASSERT(!link.waitForReadyRead(0));
+    KT_ASSERT(link.waitForBytesWritten(100));
+    KT_ASSERT(link.waitForReadyRead(100));
+    KT_ASSERT_EQ(link.readAll(), QByteArray("\xC0\xC0", 2));
+}
+
+KT_TEST(esp_capture_merges_byte_reads,
+        "byte-wise reads right after each other become one record") {
+    const QString path = QDir(QDir::tempPath()).filePath(QStringLiteral("kt_capture_merge.espcap"));
+    LoopbackTransport loopback;
+    EspCaptureTransport capture(&loopback);
+    KT_ASSERT(capture.open(path));
+    capture.write("\xC0\x00\x0A\xC0", 4);
+    QByteArray received;
+    for (int i = 0; i < 4; i++) received.append(capture.read(1));
+    capture.finish();
+    KT_ASSERT_EQ(received, QByteArray("\xC0\x00\x0A\xC0", 4));
+    KT_ASSERT_EQ(capture.records(), static_cast<quint64>(2));
+
+    EspReplayTransport replay;
+    KT_ASSERT(replay.open(path));
+    KT_ASSERT_EQ(replay.write("\xC0\x00\x0A\xC0", 4), static_cast<qint64>(4));
+    KT_ASSERT_EQ(replay.readAll(), QByteArray("\xC0\x00\x0A\xC0", 4));
+    KT_ASSERT(replay.atEnd());
+    QFile::remove(path);
+}
+
+#endif // KT_SELFTEST
@@ -0,0 +1,252 @@
+/**
+ ******************************************************************************
+ * @file           : src/transport.h
+ * @brief          : Declares the byte transports under the SLIP layer.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ * @details
+ *
+ * EspToolQt moves every byte through an EspTransport. By default that is the
+ * serial port; a capture decorator records the exchange to a file and the
+ * replay transport plays such a file back without a board, so the frame
+ * decoder and protocol code run on the recorded traffic deterministically.
+ *
+ * Capture file: the 8 byte magic "ESPCAP1\n" followed by records of
+ * direction (1 byte, 0 = host to target, 1 = target to host), timestamp in
+ * nanoseconds since the capture started (8 bytes LE), length (4 bytes LE)
+ * and the chunk itself. Reads or writes in the same direction less than
+ * 2 ms apart share one record, so byte-wise reads do not grow the file by
+ * a header per byte.
+ *
+ * EspFaultTransport degrades another transport with latency, jitter, a
+ * bandwidth cap, dropped bytes, bit flips and burst stalls, all driven by a
+ * seed, to exercise the retry and timeout paths without a bad USB hub.
+ *
+ * Usage Example:
+ * ```cpp
+ * tool.startCapture("flash.espcap");
+ * tool.autoConnect(port);
+ * tool.readFlash(0, 0x100000);
+ * tool.stopCapture();
+ *
+ * EspReplayTransport replay;
+ * replay.open("flash.espcap");
+ * tool.setTransport(&replay);
+ * tool.autoConnect(port);            // same calls as the recorded session
+ * tool.readFlash(0, 0x100000);
+ *
+ * EspFaultTransport::Faults faults;
+ * faults.latency_ms = 20;
+ * faults.drop_rate = 1e-5;
+ * EspFaultTransport degraded(tool.serialTransport(), faults);
+ * tool.setTransport(&degraded);
+ * ```
+ *
+ ******************************************************************************
+ */
+
+#ifndef ESP_TRANSPORT_H
+#define ESP_TRANSPORT_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+class QSerialPort;
+
+class EspTransport
+{
+public:
+    virtual ~EspTransport() = default;
+
+    virtual bool isOpen() const = 0;
+    virtual bool hasError() const = 0;
+    virtual QString errorString() const = 0;
+    virtual qint64 write(const char *data, qint64 size) = 0;
+    virtual bool waitForBytesWritten(int timeout_ms) = 0;
+    virtual bool waitForReadyRead(int timeout_ms) = 0;
+    virtual QByteArray read(qint64 max_size) = 0;
+    virtual QByteArray readAll() = 0;
+    virtual void clearInput() = 0;
+    virtual void clear() = 0;
+    virtual void close() {}
+};
+
+// QSerialPort as a transport, the default
+class EspSerialTransport : public EspTransport
+{
+public:
+    explicit EspSerialTransport(QSerialPort *port) : port_(port) {}
+
+    bool isOpen() const override;
+    bool hasError() const override;
+    QString errorString() const override;
+    qint64 write(const char *data, qint64 size) override;
+    bool waitForBytesWritten(int timeout_ms) override;
+    bool waitForReadyRead(int timeout_ms) override;
+    QByteArray read(qint64 max_size) override;
+    QByteArray readAll() override;
+    void clearInput() override;
+    void clear() override;
+
+private:
+    QSerialPort *port_;
+};
+
+// Records every chunk passing through another transport
+class EspCaptureTransport : public EspTransport
+{
+public:
+    enum Direction : uint8_t { ToTarget = 0, FromTarget = 1 };
+
+    explicit EspCaptureTransport(EspTransport *inner) : inner_(inner) {}
+    ~EspCaptureTransport() override;
+
+    bool open(const QString &path);
+    void finish();
+    quint64 records() const { return records_; }
+
+    bool isOpen() const override { return inner_->isOpen(); }
+    bool hasError() const override { return inner_->hasError(); }
+    QString errorString() const override { return inner_->errorString(); }
+    qint64 write(const char *data, qint64 size) override;
+    bool waitForBytesWritten(int timeout_ms) override { return inner_->waitForBytesWritten(timeout_ms); }
+    bool waitForReadyRead(int timeout_ms) override { return inner_->waitForReadyRead(timeout_ms); }
+    QByteArray read(qint64 max_size) override;
+    QByteArray readAll() override;
+    void clearInput() override { inner_->clearInput(); }
+    void clear() override { inner_->clear(); }
+    void close() override { inner_->close(); }
+
+private:
+    void record(Direction direction, const char *data, qint64 size);
+
+    EspTransport *inner_;
+    QFile file_;
+    QByteArray pending_;
+    int open_record_ = -1;          // header of the record still growing in pending_
+    Direction open_direction_ = ToTarget;
+    qint64 open_last_ns_ = 0;
+    quint64 records_ = 0;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Plays a capture back: writes are checked against the recorded host
+// traffic, reads return the recorded target traffic once the host has
+// written everything that preceded it
+class EspReplayTransport : public EspTransport
+{
+public:
+    struct Record {
+        uint8_t direction = 0;
+        qint64 timestamp_ns = 0;
+        QByteArray data;
+    };
+
+    bool open(const QString &path);
+    bool load(const QByteArray &capture);
+    void setPaced(bool paced) { paced_ = paced; }  // hold replies back for their recorded latency
+    quint64 mismatchedBytes() const { return mismatched_bytes_; }
+    bool atEnd() const { return record_ >= records_.size(); }
+
+    bool isOpen() const override { return open_; }
+    bool hasError() const override { return false; }
+    QString errorString() const override { return error_; }
+    qint64 write(const char *data, qint64 size) override;
+    bool waitForBytesWritten(int) override { return open_; }
+    bool waitForReadyRead(int timeout_ms) override;
+    QByteArray read(qint64 max_size) override;
+    QByteArray readAll() override;
+    void clearInput() override {}
+    void clear() override {}
+    void close() override { open_ = false; }
+
+private:
+    bool rxReady() const;
+
+    std::vector<Record> records_;
+    size_t record_ = 0;
+    int record_pos_ = 0;
+    bool open_ = false;
+    bool paced_ = false;
+    quint64 mismatched_bytes_ = 0;
+    qint64 anchor_ns_ = 0;      // host clock minus capture clock at the last write
+    QString error_;
+};
+
+// Injects link faults between EspToolQt and another transport. Bytes in
+// both directions are held back until their delivery time, which adds
+// latency, jitter and the serialisation delay of the bandwidth cap; drops
+// and bit flips are applied per byte, stalls per chunk
+class EspFaultTransport : public EspTransport
+{
+public:
+    struct Faults {
+        int latency_ms = 0;             // one way, both directions
+        int jitter_ms = 0;              // uniform 0..jitter_ms added per chunk
+        quint64 bandwidth_bps = 0;      // bits per second per direction, 0 = unlimited
+        double drop_rate = 0;           // probability a byte is lost
+        double bit_flip_rate = 0;       // probability a byte gets one bit flipped
+        double stall_rate = 0;          // probability a chunk starts a stall
+        int stall_ms = 0;               // length of a stall
+        bool faults_to_target = true;   // also corrupt host to target traffic
+        quint64 seed = 1;
+    };
+
+    struct Stats {
+        quint64 dropped = 0;
+        quint64 flipped = 0;
+        quint64 stalls = 0;
+    };
+
+    EspFaultTransport(EspTransport *inner, const Faults &faults);
+
+    const Stats &stats() const { return stats_; }
+
+    bool isOpen() const override { return inner_->isOpen(); }
+    bool hasError() const override { return inner_->hasError(); }
+    QString errorString() const override { return inner_->errorString(); }
+    qint64 write(const char *data, qint64 size) override;
+    bool waitForBytesWritten(int timeout_ms) override;
+    bool waitForReadyRead(int timeout_ms) override;
+    QByteArray read(qint64 max_size) override;
+    QByteArray readAll() override;
+    void clearInput() override;
+    void clear() override;
+    void close() override { inner_->close(); }
+
+private:
+    struct Chunk {
+        qint64 due_ns;
+        QByteArray data;
+    };
+
+    QByteArray corrupt(const char *data, qint64 size);
+    qint64 schedule(qint64 *link_free_ns, qint64 size);
+    void pump();
+    bool rxReady() const;
+
+    EspTransport *inner_;
+    Faults faults_;
+    Stats stats_;
+    std::mt19937_64 random_;
+    std::deque<Chunk> rx_;
+    std::deque<Chunk> tx_;
+    qint64 rx_free_ns_ = 0;
+    qint64 tx_free_ns_ = 0;
+    qint64 stalled_until_ns_ = 0;
+};
+
+#endif // ESP_TRANSPORT_H
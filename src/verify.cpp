@@ -0,0 +1,239 @@
+/**
+ ******************************************************************************
+ * @file           : src/verify.cpp
+ * @brief          : Implements pipelined flash verification.
+ * @author         : Kuraga Team
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2026 Kuraga Tech
+ * SPDX-License-Identifier: MIT
+ *
+ ******************************************************************************
+ * @details
+ *
+ * verifyFlash() keeps several 0x13 MD5 requests queued on the stub and
+ * matches the replies in order, while host MD5s of all regions are computed
+ * on worker threads. A region that fails in the pipeline is checked again
+ * on its own before the verification is declared failed.
+ *
+ * locateBadRanges() bisects a mismatching range with device MD5s down to
+ * flash sectors, so writers can repair just the broken sectors and
+ * verification can report exactly where the flash differs.
+ *
+ ******************************************************************************
+ */
+
+#include "../esptoolqt.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <thread>
+
+using std::vector;
+
+namespace {
+
+struct VerifyRegion {
+    uint32_t offset = 0;    // relative to the image
+    uint32_t size = 0;
+    QByteArray md5;
+};
+
+// Regions of ~1/64 of the flash, 64 KB to 1 MB, so small chips still get
+// a fine progress bar and big ones do not drown in round trips.
+uint32_t verifyRegionSize(uint32_t flash_size) {
+    uint32_t region = flash_size / 64;
+    region = std::max<uint32_t>(region, 64 * 1024);
+    region = std::min<uint32_t>(region, 1024 * 1024);
+    return region & ~uint32_t(0xFFF);
+}
+
+void hashRegions(const vector<uint8_t>& data, vector<VerifyRegion>& regions) {
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i = next++; i < regions.size(); i = next++) {
+            regions[i].md5 = QCryptographicHash::hash(
+                QByteArray::fromRawData(reinterpret_cast<const char*>(data.data()) + regions[i].offset, static_cast<int>(regions[i].size)),
+                QCryptographicHash::Md5);
+        }
+    };
+    const unsigned threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), regions.size());
+    vector<std::thread> pool;
+    for (unsigned i = 1; i < threads; i++) pool.emplace_back(worker);
+    worker();
+    for (std::thread& thread : pool) thread.join();
+}
+
+}
+
+// Split a range at the sector boundary closest past its middle until it is
+// one sector. When the whole range is known bad and its left half is clean,
+// the right half must be bad and is not hashed again. Returns false on a
+// device error.
+bool EspToolQt::bisectBadRanges(uint32_t memory_offset, const uint8_t* data, uint32_t size, bool known_bad, std::vector<FlashBadRange>* bad) {
+    if (isCancelled()) return false;
+    if (!known_bad) {
+        vector<uint8_t> device_md5;
+        if (!readFlashMd5(memory_offset, size, &device_md5)) return false;
+        const QByteArray md5 = QCryptographicHash::hash(
+            QByteArray::fromRawData(reinterpret_cast<const char*>(data), static_cast<int>(size)), QCryptographicHash::Md5);
+        if (device_md5 == vector<uint8_t>(md5.begin(), md5.end())) return true;
+    }
+
+    const uint32_t sector = target->FLASH_SECTOR_SIZE();
+    const uint32_t mid = (memory_offset + size / 2 + sector - 1) / sector * sector;
+    if (size <= sector || mid <= memory_offset || mid >= memory_offset + size) {
+        if (!bad->empty() && bad->back().offset + bad->back().size == memory_offset) {
+            bad->back().size += size;
+        } else {
+            bad->push_back({memory_offset, size, false});
+        }
+        return true;
+    }
+
+    const size_t bad_before = bad->size();
+    const uint32_t bad_bytes_before = bad->empty() ? 0 : bad->back().size;
+    if (!bisectBadRanges(memory_offset, data, mid - memory_offset, false, bad)) return false;
+    const bool left_clean = bad->size() == bad_before && (bad->empty() || bad->back().size == bad_bytes_before);
+    return bisectBadRanges(mid, data + (mid - memory_offset), memory_offset + size - mid, known_bad && left_clean, bad);
+}
+
+bool EspToolQt::locateBadRanges(uint32_t memory_offset, const std::vector<uint8_t>& data, std::vector<FlashBadRange>* bad, bool known_bad) {
+    bad->clear();
+    if (data.empty()) return true;
+    return bisectBadRanges(memory_offset, data.data(), data.size(), known_bad, bad);
+}
+
+void EspToolQt::logBadRanges(const std::vector<FlashBadRange>& bad) {
+    for (const FlashBadRange& range : bad) {
+        qInfo().noquote() << QString("[WARNING] Flash differs at [0x%1-0x%2]%3")
+            .arg(QString::number(range.offset, 16).toUpper())
+            .arg(QString::number(range.offset + range.size, 16).toUpper())
+            .arg(range.repaired ? ", rewritten" : "");
+    }
+}
+
+bool EspToolQt::verifyFlash(uint32_t memory_offset, std::vector<uint8_t> data) {
+    QElapsedTimer timer;
+    timer.start();
+    EspTrace::Span span = traceSpan("verify_flash", "session");
+    span.arg("offset", memory_offset);
+    span.arg("size", static_cast<qint64>(data.size()));
+    lastBadRanges.clear();
+
+    // check that target is connected
+    if (target == NULL || !io()->isOpen()) {
+        qInfo() << "[Error] Target is not connected";
+        return false;
+    }
+    if (data.empty()) return true;
+
+    const uint32_t total_length = data.size();
+    const uint32_t flash_size = esp_target_info.flash_size ? esp_target_info.flash_size : total_length;
+    const uint32_t region_size = verifyRegionSize(flash_size);
+    vector<VerifyRegion> regions;
+    for (uint32_t offset = 0; offset < total_length; offset += region_size) {
+        VerifyRegion region;
+        region.offset = offset;
+        region.size = std::min(region_size, total_length - offset);
+        regions.push_back(region);
+    }
+
+    // host hashes in the background while the device works
+    std::thread host_hashing([&data, &regions]() { hashRegions(data, regions); });
+    bool host_hashed = false;
+
+    const uint32_t depth = std::max<uint32_t>(1, verify_md5_depth);
+    std::deque<size_t> in_flight;
+    size_t next_request = 0;
+    size_t retried = 0;
+    bool verify_result = true;
+
+    for (size_t done = 0; done < regions.size() && verify_result; done++) {
+        EspTrace::Span region_span = traceSpan("verify_region", "verify");
+        region_span.arg("offset", memory_offset + regions[done].offset);
+        region_span.arg("size", regions[done].size);
+        while (next_request < regions.size() && in_flight.size() < depth) {
+            // only a request with nothing ahead of it may clear the input
+            const bool pipelined = !in_flight.empty();
+            if (!pipelined) serial_frame_buffer_.clear();
+            if (!sendFlashMd5Request(memory_offset + regions[next_request].offset, regions[next_request].size, pipelined)) break;
+            in_flight.push_back(next_request++);
+        }
+
+        vector<uint8_t> device_md5;
+        const bool received = !in_flight.empty() && receiveFlashMd5(regions[done].size, &device_md5, true);
+        if (!in_flight.empty()) in_flight.pop_front();
+        if (isCancelled()) {
+            host_hashing.join();
+            closePort();
+            return false;
+        }
+        if (!host_hashed) {
+            host_hashing.join();
+            host_hashed = true;
+        }
+
+        const VerifyRegion& region = regions[done];
+        if (!received || device_md5 != vector<uint8_t>(region.md5.begin(), region.md5.end())) {
+            // drop queued replies, then check this region alone like before
+            for (size_t i = 0; i < in_flight.size(); i++) {
+                vector<uint8_t> stale;
+                receiveFlashMd5(regions[in_flight[i]].size, &stale, true);
+            }
+            serial_frame_buffer_.clear();
+            next_request = done + 1;
+            in_flight.clear();
+            retried++;
+
+            const vector<uint8_t> block(data.begin() + region.offset, data.begin() + region.offset + region.size);
+            verify_result = false;
+            for (int attempt = 0; attempt < 3 && !verify_result; attempt++) {
+                if (isCancelled()) {
+                    closePort();
+                    return false;
+                }
+                qInfo() << "Retry to verify data block";
+                verify_result = verifyFlashBlockMd5(memory_offset + region.offset, block);
+            }
+            if (!verify_result) {
+                qInfo().noquote() << QString("Verification failed at memory range [0x%1-0x%2]")
+                    .arg(QString::number(memory_offset + region.offset, 16).toUpper())
+                    .arg(QString::number(memory_offset + region.offset + region.size, 16).toUpper());
+                if (locateBadRanges(memory_offset + region.offset, block, &lastBadRanges)) logBadRanges(lastBadRanges);
+                break;
+            }
+        }
+
+        // update progress bar
+        quint64 verified = region.offset + region.size;
+        reportProgress(verified, static_cast<quint64>(total_length));
+    }
+    if (!host_hashed) host_hashing.join();
+    serial_frame_buffer_.clear();
+    if (!verify_result) return false;
+
+    const qint64 elapsed_ms = std::max<qint64>(1, timer.elapsed());
+    const double mb_s = (static_cast<double>(total_length) / (1024.0 * 1024.0)) / (static_cast<double>(elapsed_ms) / 1000.0);
+    qInfo().noquote() << QString("[OK] Verified %1 bytes in %2 ms (%3 MB/s)")
+        .arg(total_length).arg(elapsed_ms).arg(mb_s, 0, 'f', 2);
+    if (isDiagEnabled()) {
+        qInfo().noquote() << QString("[esp-diag] verifyFlash offset=0x%1 size=%2 region=%3 regions=%4 depth=%5 retried=%6 total_ms=%7 mb_s=%8")
+            .arg(QString::number(memory_offset, 16).toUpper())
+            .arg(total_length)
+            .arg(region_size)
+            .arg(static_cast<qulonglong>(regions.size()))
+            .arg(depth)
+            .arg(static_cast<qulonglong>(retried))
+            .arg(elapsed_ms)
+            .arg(mb_s, 0, 'f', 2);
+        logRtoDiag();
+    }
+    return true;
+}